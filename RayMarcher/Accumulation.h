@@ -0,0 +1,110 @@
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <string>
+
+#include "FrameParams.h"
+#include "RenderTargetPool.h"
+
+// What the GPU does with frames in which nothing changed
+enum IdleMode { IDLE_OFF, IDLE_SKIP, IDLE_ACCUMULATE };
+
+inline bool ParseIdleMode(const std::string& name, IdleMode& mode)
+{
+	if (name == "off") mode = IDLE_OFF;
+	else if (name == "skip") mode = IDLE_SKIP;
+	else if (name == "accumulate") mode = IDLE_ACCUMULATE;
+	else return false;
+	return true;
+}
+
+// Spends the frames of a still camera on something useful. The frame parameters
+// are compared with the previous frame's, ignoring the fields that change every
+// frame regardless; while they are equal the image can't change either. With
+// IDLE_SKIP those frames aren't dispatched at all. With IDLE_ACCUMULATE each one
+// marches the rays through another subpixel offset and compute.glsl averages
+// them in an RGBA32F target for antialiasing, until MAX_SAMPLES after which
+// the frames are skipped. Any change starts over from one sample.
+class Accumulation {
+public:
+	static const unsigned MAX_SAMPLES = 64;
+
+	Accumulation(IdleMode mode, RenderTargetPool& targets, GLuint imageUnit) : m_Mode(mode) {
+		if (mode == IDLE_ACCUMULATE) {
+			targets.add(GL_RGBA32F, imageUnit);
+		}
+	}
+
+	Accumulation(const Accumulation&) = delete;
+	Accumulation& operator=(const Accumulation&) = delete;
+
+	// For changes params doesn't show: a new scene, or the image overwritten by something else
+	void invalidate() {
+		m_HasLast = false;
+	}
+
+	// Fills the jitter and accumulation fields of params. Returns false if the
+	// frame doesn't need to be rendered, the image from before is still right.
+	// Frames that aren't enabled are always rendered, and plainly.
+	bool apply(FrameParams& params, bool enabled) {
+		params.jitter = glm::vec2(0.0f);
+		params.useAccumulation = 0;
+		params.accumulatedFrames = 0;
+		if (!enabled) {
+			invalidate();
+			return true;
+		}
+
+		FrameParams key = params;
+		key.time = 0.0f;
+		key.useReprojection = 0;
+		key.prevCameraToWorld = glm::mat4(1.0f);
+		key.worldToClip = glm::mat4(1.0f);
+		key.lightCacheFrame = 0;
+
+		bool unchanged = m_HasLast && std::memcmp(&key, &m_Last, sizeof(FrameParams)) == 0;
+		m_Last = key;
+		m_HasLast = true;
+		m_Samples = unchanged ? m_Samples : 0;
+
+		switch (m_Mode) {
+		case IDLE_SKIP:
+			return !unchanged;
+		case IDLE_ACCUMULATE:
+			if (m_Samples >= MAX_SAMPLES) return false;
+			params.jitter = glm::vec2(halton(m_Samples, 2), halton(m_Samples, 3));
+			params.useAccumulation = 1;
+			params.accumulatedFrames = m_Samples++;
+			return true;
+		default:
+			return true;
+		}
+	}
+
+	unsigned samples() const { return m_Samples; }
+
+private:
+	IdleMode m_Mode;
+	FrameParams m_Last;
+	bool m_HasLast = false;
+	unsigned m_Samples = 0;
+
+	// Low discrepancy offsets in [0, 1), 0 for the first sample so a single frame
+	// looks the same as without accumulation
+	static float halton(unsigned index, unsigned base) {
+		float result = 0.0f;
+		float fraction = 1.0f;
+		while (index > 0) {
+			fraction /= base;
+			result += fraction * (index % base);
+			index /= base;
+		}
+		return result;
+	}
+};
+
+#endif //ACCUMULATION_H
@@ -0,0 +1,209 @@
+#ifndef BRICK_MAP_H
+#define BRICK_MAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "FrameParams.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+// Sparse narrow-band distance field. The scene bounds are split into a coarse
+// grid of cells, each covering BRICK_SIZE^3 fine voxels. Cells close to a surface
+// get a brick of (BRICK_SIZE + 1)^3 distance samples on the voxel corners, so a
+// brick interpolates without its neighbours; bricks are packed into an R16F
+// atlas. The RG32F indirection grid holds the brick index of every cell, or -1
+// and the distance from the cell center to the nearest surface for empty cells,
+// which lets the march skip them in one step.
+class BrickMap {
+public:
+	static const unsigned BRICK_SIZE = 8;
+	static const unsigned BRICK_SAMPLES = BRICK_SIZE + 1;
+
+	BrickMap(GLuint atlasUnit, GLuint indirectionUnit) : m_AtlasUnit(atlasUnit), m_IndirectionUnit(indirectionUnit) {}
+
+	~BrickMap() {
+		if (m_Atlas) glDeleteTextures(1, &m_Atlas);
+		if (m_Indirection) glDeleteTextures(1, &m_Indirection);
+	}
+
+	BrickMap(const BrickMap&) = delete;
+	BrickMap& operator=(const BrickMap&) = delete;
+
+	// resolution is the fine voxel count along the longest axis of the scene bounds.
+	// It is halved until the bricks fit in budgetBytes of half float atlas.
+	bool build(const Scene& scene, unsigned resolution, size_t budgetBytes) {
+		m_Valid = false;
+		if (scene.bvhNodes().empty()) return false;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		size_t maxBricks = budgetBytes / (BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES * 2);
+
+		ThreadPool pool;
+		bool fits = false;
+		for (; resolution >= 2 * BRICK_SIZE && !fits; resolution /= 2) {
+			if (!classify(scene, resolution, pool)) return false;
+			fits = m_BrickCount <= maxBricks;
+			if (!fits) {
+				std::cout << "Brick map: " << m_BrickCount << " bricks at resolution " << resolution << " exceed the budget, halving" << std::endl;
+			}
+		}
+		if (!fits) {
+			std::cout << "Brick map: scene does not fit in " << budgetBytes / (1024 * 1024) << " MB" << std::endl;
+			return false;
+		}
+
+		fillBricks(scene, pool);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Baked brick map: " << m_Grid.x << "x" << m_Grid.y << "x" << m_Grid.z << " cells, " << m_BrickCount << " bricks ("
+			<< memoryBytes() / (1024 * 1024) << " MB) in " << std::chrono::duration<double>(end - start).count() << " s" << std::endl;
+
+		upload();
+		m_Valid = true;
+		return true;
+	}
+
+	// Fills the brick map fields of params; the map is only sampled if enabled and
+	// the last build() succeeded
+	void apply(FrameParams& params, bool enabled) const {
+		params.useBricks = enabled && m_Valid ? 1 : 0;
+		params.brickMin = m_Min;
+		params.brickCell = m_Cell;
+	}
+
+	size_t brickCount() const { return m_BrickCount; }
+
+	size_t memoryBytes() const {
+		return (size_t)m_AtlasDims.x * m_AtlasDims.y * m_AtlasDims.z * 2 + (size_t)m_Grid.x * m_Grid.y * m_Grid.z * 8;
+	}
+
+private:
+	GLuint m_AtlasUnit;
+	GLuint m_IndirectionUnit;
+	GLuint m_Atlas = 0;
+	GLuint m_Indirection = 0;
+	bool m_Valid = false;
+
+	glm::uvec3 m_Grid = glm::uvec3(0);
+	glm::vec3 m_Min = glm::vec3(0.0f);
+	float m_Cell = 0.0f;
+	size_t m_BrickCount = 0;
+
+	glm::uvec3 m_AtlasBricks = glm::uvec3(0);
+	glm::uvec3 m_AtlasDims = glm::uvec3(0);
+
+	std::vector<glm::vec2> m_Entries;
+	std::vector<float> m_AtlasData;
+
+	size_t cellIndex(unsigned x, unsigned y, unsigned z) const {
+		return ((size_t)z * m_Grid.y + y) * m_Grid.x + x;
+	}
+
+	// Sizes the grid for resolution and decides which cells need a brick
+	bool classify(const Scene& scene, unsigned resolution, ThreadPool& pool) {
+		const SceneBvhNode& root = scene.bvhNodes()[0];
+		glm::vec3 extent = root.max - root.min;
+		float longest = glm::max(extent.x, glm::max(extent.y, extent.z));
+		if (!(longest > 0.0f)) return false;
+
+		// One cell of padding on every side keeps surfaces off the grid boundary
+		m_Cell = longest * BRICK_SIZE / resolution;
+		for (int axis = 0; axis < 3; axis++) {
+			m_Grid[axis] = (unsigned)std::ceil(extent[axis] / m_Cell) + 2;
+		}
+		m_Min = 0.5f * (root.min + root.max) - 0.5f * m_Cell * glm::vec3(m_Grid);
+
+		// A cell is empty if no surface comes within its half diagonal plus a band of
+		// two voxel diagonals, so empty cells always allow a step of at least that band
+		float halfDiagonal = 0.5f * std::sqrt(3.0f) * m_Cell;
+		float band = 2.0f * std::sqrt(3.0f) * m_Cell / BRICK_SIZE;
+
+		m_Entries.assign((size_t)m_Grid.x * m_Grid.y * m_Grid.z, glm::vec2(0.0f));
+		pool.parallelFor(m_Grid.y * m_Grid.z, [&](unsigned row) {
+			unsigned y = row % m_Grid.y;
+			unsigned z = row / m_Grid.y;
+			for (unsigned x = 0; x < m_Grid.x; x++) {
+				glm::vec3 center = m_Min + m_Cell * (glm::vec3(x, y, z) + 0.5f);
+				float dist = scene.evaluate(center);
+				bool empty = std::abs(dist) > halfDiagonal + band;
+				m_Entries[cellIndex(x, y, z)] = glm::vec2(empty ? -1.0f : 0.0f, dist);
+			}
+		});
+
+		m_BrickCount = 0;
+		for (glm::vec2& entry : m_Entries) {
+			if (entry.x >= 0.0f) {
+				entry.x = (float)m_BrickCount++;
+			}
+		}
+		return true;
+	}
+
+	void fillBricks(const Scene& scene, ThreadPool& pool) {
+		unsigned side = glm::max(1u, (unsigned)std::ceil(std::cbrt((double)m_BrickCount)));
+		m_AtlasBricks = glm::uvec3(side, side, std::max<size_t>(1, (m_BrickCount + side * side - 1) / (side * side)));
+		m_AtlasDims = m_AtlasBricks * BRICK_SAMPLES;
+		m_AtlasData.assign((size_t)m_AtlasDims.x * m_AtlasDims.y * m_AtlasDims.z, 0.0f);
+
+		std::vector<glm::uvec3> cells(m_BrickCount);
+		for (unsigned z = 0; z < m_Grid.z; z++) {
+			for (unsigned y = 0; y < m_Grid.y; y++) {
+				for (unsigned x = 0; x < m_Grid.x; x++) {
+					float brick = m_Entries[cellIndex(x, y, z)].x;
+					if (brick >= 0.0f) cells[(size_t)brick] = glm::uvec3(x, y, z);
+				}
+			}
+		}
+
+		float voxel = m_Cell / BRICK_SIZE;
+		pool.parallelFor((unsigned)m_BrickCount, [&](unsigned brick) {
+			glm::vec3 cellMin = m_Min + m_Cell * glm::vec3(cells[brick]);
+			glm::uvec3 origin = BRICK_SAMPLES * glm::uvec3(brick % m_AtlasBricks.x, (brick / m_AtlasBricks.x) % m_AtlasBricks.y,
+				brick / (m_AtlasBricks.x * m_AtlasBricks.y));
+
+			for (unsigned z = 0; z < BRICK_SAMPLES; z++) {
+				for (unsigned y = 0; y < BRICK_SAMPLES; y++) {
+					float* out = &m_AtlasData[((size_t)(origin.z + z) * m_AtlasDims.y + origin.y + y) * m_AtlasDims.x + origin.x];
+					for (unsigned x = 0; x < BRICK_SAMPLES; x++) {
+						out[x] = scene.evaluate(cellMin + voxel * glm::vec3(x, y, z));
+					}
+				}
+			}
+		});
+	}
+
+	void upload() {
+		if (!m_Atlas) glGenTextures(1, &m_Atlas);
+		if (!m_Indirection) glGenTextures(1, &m_Indirection);
+
+		glActiveTexture(GL_TEXTURE0 + m_AtlasUnit);
+		glBindTexture(GL_TEXTURE_3D, m_Atlas);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, m_AtlasDims.x, m_AtlasDims.y, m_AtlasDims.z, 0, GL_RED, GL_FLOAT, m_AtlasData.data());
+
+		glActiveTexture(GL_TEXTURE0 + m_IndirectionUnit);
+		glBindTexture(GL_TEXTURE_3D, m_Indirection);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, m_Grid.x, m_Grid.y, m_Grid.z, 0, GL_RG, GL_FLOAT, m_Entries.data());
+		glActiveTexture(GL_TEXTURE0);
+
+		m_AtlasData.clear();
+		m_AtlasData.shrink_to_fit();
+		m_Entries.clear();
+		m_Entries.shrink_to_fit();
+	}
+};
+
+#endif //BRICK_MAP_H
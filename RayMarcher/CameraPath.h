@@ -0,0 +1,73 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+struct CameraKey {
+	float time;
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+};
+
+// Recorded camera poses, one per rendered frame. Stored as text, one key per
+// line: "time x y z yaw pitch". Lines starting with '#' are ignored.
+class CameraPath {
+public:
+	void record(float time, const Camera& camera) {
+		m_Keys.push_back({ time, camera.Position, camera.Yaw, camera.Pitch });
+	}
+
+	bool load(const std::string& path) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cout << "Failed to open camera path " << path << std::endl;
+			return false;
+		}
+
+		m_Keys.clear();
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty() || line[0] == '#') continue;
+
+			std::istringstream stream(line);
+			CameraKey key;
+			if (stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch) {
+				m_Keys.push_back(key);
+			}
+		}
+		return !m_Keys.empty();
+	}
+
+	bool save(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file << "# time x y z yaw pitch\n";
+		for (const CameraKey& key : m_Keys) {
+			file << key.time << " " << key.position.x << " " << key.position.y << " " << key.position.z << " "
+				<< key.yaw << " " << key.pitch << "\n";
+		}
+		return (bool)file;
+	}
+
+	size_t size() const { return m_Keys.size(); }
+	const CameraKey& operator[](size_t i) const { return m_Keys[i]; }
+
+	static Camera toCamera(const CameraKey& key) {
+		return Camera(key.position, glm::vec3(0.0f, 1.0f, 0.0f), key.yaw, key.pitch);
+	}
+
+private:
+	std::vector<CameraKey> m_Keys;
+};
+
+#endif //CAMERA_PATH_H
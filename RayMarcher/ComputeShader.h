@@ -5,16 +5,38 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <fstream>
 #include <iostream>
 
+#include "ProgramCache.h"
+
+// Returns a "#define name value" line for the defines argument of ComputeShader
+inline std::string ShaderDefine(const std::string& name, const std::string& value) {
+	return "#define " + name + " " + value + "\n";
+}
+
+inline std::string ShaderDefine(const std::string& name, int value) {
+	return ShaderDefine(name, std::to_string(value));
+}
+
+// Code that replaces a "//@name" marker line in the shader source
+struct ShaderSplice {
+	std::string name;
+	std::string code;
+};
+
 class ComputeShader {
 public:
 	unsigned int m_ID = NULL;
+	GLint m_LocalSize[3] = { 1, 1, 1 };
 
 	ComputeShader() {}
 
-	ComputeShader(const char* path) {
+	// #include "file" lines are expanded relative to path, then splices replace their
+	// marker lines and defines are inserted right after the #version line
+	ComputeShader(const char* path, const std::string& defines = "", const std::vector<ShaderSplice>& splices = {}) {
 		std::string code;
 		std::ifstream shaderFile(path);
 
@@ -29,21 +51,50 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
 		}
+		std::string directory(path);
+		directory = directory.substr(0, directory.find_last_of("/\\") + 1);
+		expandIncludes(code, directory, 0);
+
+		for (const ShaderSplice& splice : splices) {
+			std::string marker = "//@" + splice.name;
+			size_t start = code.find(marker);
+			if (start == std::string::npos) {
+				std::cout << "ERROR::SHADER::MISSING_SPLICE_MARKER " << marker << std::endl;
+				continue;
+			}
+			size_t end = code.find('\n', start);
+			code.replace(start, end == std::string::npos ? std::string::npos : end - start, splice.code);
+		}
+		if (!defines.empty()) {
+			size_t versionEnd = code.find('\n', code.find("#version"));
+			code.insert(versionEnd == std::string::npos ? code.size() : versionEnd + 1, defines);
+		}
 		const char* shaderCode = code.c_str();
 
-		GLuint compute = glCreateShader(GL_COMPUTE_SHADER);
-		glShaderSource(compute, 1, &shaderCode, NULL);
-		glCompileShader(compute);
+		m_ID = glCreateProgram();
 
-		checkCompileErrors(compute, "COMPUTE");
+		uint64_t cacheKey = ProgramCache::key({ "COMPUTE", code });
+		if (!ProgramCache::load(m_ID, cacheKey)) {
+			GLuint compute = glCreateShader(GL_COMPUTE_SHADER);
+			glShaderSource(compute, 1, &shaderCode, NULL);
+			glCompileShader(compute);
 
-		m_ID = glCreateProgram();
-		glAttachShader(m_ID, compute);
-		glLinkProgram(m_ID);
+			checkCompileErrors(compute, "COMPUTE");
+
+			glAttachShader(m_ID, compute);
+			ProgramCache::prepare(m_ID);
+			glLinkProgram(m_ID);
+
+			checkCompileErrors(m_ID, "PROGRAM");
+
+			glDetachShader(m_ID, compute);
+			glDeleteShader(compute);
 
-		checkCompileErrors(m_ID, "PROGRAM");
+			ProgramCache::store(m_ID, cacheKey);
+		}
 
-		glDeleteShader(compute);
+		glGetProgramiv(m_ID, GL_COMPUTE_WORK_GROUP_SIZE, m_LocalSize);
+		cacheUniforms();
 	}
 
 	void use() {
@@ -54,48 +105,122 @@ public:
 		glDispatchCompute(groupsX, groupsY, groupsZ);
 	}
 
-	void setBool(std::string name, bool value) const {
-		glUniform1i(glGetUniformLocation(m_ID, name.c_str()), (int)value);
+	// Dispatches enough workgroups to cover width x height invocations; the shader bounds-checks the rest
+	void dispatchPixels(GLuint width, GLuint height) {
+		glDispatchCompute((width + m_LocalSize[0] - 1) / m_LocalSize[0], (height + m_LocalSize[1] - 1) / m_LocalSize[1], 1);
+	}
+
+	// Location resolved when the program was linked, -1 (ignored by glUniform*) if not active
+	GLint location(const std::string& name) const {
+		auto it = m_Uniforms.find(name);
+		return it == m_Uniforms.end() ? -1 : it->second;
+	}
+
+	void setBool(const std::string& name, bool value) const {
+		glUniform1i(location(name), (int)value);
 	}
-	void setInt(std::string name, int value) const {
-		glUniform1i(glGetUniformLocation(m_ID, name.c_str()), value);
+	void setInt(const std::string& name, int value) const {
+		glUniform1i(location(name), value);
 	}
-	void setFloat(std::string name, float value) const {
-		glUniform1f(glGetUniformLocation(m_ID, name.c_str()), value);
+	void setFloat(const std::string& name, float value) const {
+		glUniform1f(location(name), value);
 	}
 
-	void setVec2(std::string name, glm::vec2 value) const {
-		glUniform2fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec2(const std::string& name, glm::vec2 value) const {
+		glUniform2fv(location(name), 1, &(value.x));
 	}
-	void setVec2(std::string name, float x, float y) const {
-		glUniform2f(glGetUniformLocation(m_ID, name.c_str()), x, y);
+	void setVec2(const std::string& name, float x, float y) const {
+		glUniform2f(location(name), x, y);
 	}
 
-	void setVec3(std::string name, glm::vec3 value) const {
-		glUniform3fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec3(const std::string& name, glm::vec3 value) const {
+		glUniform3fv(location(name), 1, &(value.x));
 	}
-	void setVec3(std::string name, float x, float y, float z) const {
-		glUniform3f(glGetUniformLocation(m_ID, name.c_str()), x, y, z);
+	void setVec3(const std::string& name, float x, float y, float z) const {
+		glUniform3f(location(name), x, y, z);
 	}
 
-	void setVec4(std::string name, glm::vec4 value) const {
-		glUniform4fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec4(const std::string& name, glm::vec4 value) const {
+		glUniform4fv(location(name), 1, &(value.x));
 	}
-	void setVec4(std::string name, float x, float y, float z, float w) const {
-		glUniform4f(glGetUniformLocation(m_ID, name.c_str()), x, y, z, w);
+	void setVec4(const std::string& name, float x, float y, float z, float w) const {
+		glUniform4f(location(name), x, y, z, w);
 	}
 
-	void setMat2(std::string name, glm::mat2 value) const {
-		glUniformMatrix2fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat2(const std::string& name, glm::mat2 value) const {
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
-	void setMat3(std::string name, glm::mat3 value) const {
-		glUniformMatrix3fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat3(const std::string& name, glm::mat3 value) const {
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
-	void setMat4(std::string name, glm::mat4 value) const {
-		glUniformMatrix4fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat4(const std::string& name, glm::mat4 value) const {
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
 
 private:
+	static const int MAX_INCLUDE_DEPTH = 8;
+
+	std::unordered_map<std::string, GLint> m_Uniforms;
+
+	// GLSL has no #include; replaces every line starting with one by the named file
+	static void expandIncludes(std::string& code, const std::string& directory, int depth) {
+		size_t start = 0;
+		while ((start = code.find("#include", start)) != std::string::npos) {
+			// Only a directive, first on its line after whitespace; not in comments or code
+			size_t lineStart = start == 0 ? 0 : code.rfind('\n', start - 1) + 1;
+			if (code.find_first_not_of(" \t", lineStart) != start) {
+				start += 8;
+				continue;
+			}
+
+			size_t end = code.find('\n', start);
+			size_t open = code.find('"', start);
+			size_t close = open == std::string::npos ? open : code.find('"', open + 1);
+			if (close == std::string::npos || (end != std::string::npos && close > end)) {
+				std::cout << "ERROR::SHADER::MALFORMED_INCLUDE" << std::endl;
+				start = end;
+				continue;
+			}
+
+			std::string name = code.substr(open + 1, close - open - 1);
+			std::ifstream file(directory + name);
+			if (!file || depth >= MAX_INCLUDE_DEPTH) {
+				std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << name << std::endl;
+				start = end;
+				continue;
+			}
+
+			std::string included((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			expandIncludes(included, directory, depth + 1);
+			code.replace(start, end == std::string::npos ? std::string::npos : end - start, included);
+			start += included.size();
+		}
+	}
+
+	void cacheUniforms() {
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(m_ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(m_ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<GLchar> buffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length;
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(m_ID, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+
+			// Members of uniform blocks have no location
+			std::string name(buffer.data(), length);
+			GLint location = glGetUniformLocation(m_ID, name.c_str());
+			if (location < 0) continue;
+
+			m_Uniforms[name] = location;
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				m_Uniforms[name.substr(0, name.size() - 3)] = location;
+			}
+		}
+	}
+
 	void checkCompileErrors(GLuint shader, std::string type) {
 		GLint success;
 		GLchar infoLog[1024];
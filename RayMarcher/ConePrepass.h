@@ -0,0 +1,49 @@
+#ifndef CONE_PREPASS_H
+#define CONE_PREPASS_H
+
+#include <glad/glad.h>
+
+#include "ComputeShader.h"
+#include "FrameParams.h"
+#include "RenderTargetPool.h"
+#include "Scene.h"
+#include "SceneVariants.h"
+
+// Coarse pass of coarse-to-fine marching. cone.glsl marches one cone per tile of
+// CONE_TILE x CONE_TILE pixels and writes the distance it proved empty into an
+// R32F image with one texel per tile; compute.glsl starts every primary ray of
+// the tile from there instead of the camera.
+class ConePrepass {
+public:
+	static const GLuint TILE = 8;
+
+	ConePrepass(const char* path, RenderTargetPool& targets, GLuint imageUnit) : m_Variants(path, ""), m_Targets(targets) {
+		m_Target = targets.add(GL_R32F, imageUnit, TILE);
+	}
+
+	ConePrepass(const ConePrepass&) = delete;
+	ConePrepass& operator=(const ConePrepass&) = delete;
+
+	// Picks the cone program matching the scene, like the ray march variants
+	void setScene(const Scene& scene, bool compiled) {
+		m_Shader = &m_Variants.get(scene, compiled);
+	}
+
+	// Runs the prepass with the frame parameters already bound; the ray march
+	// dispatched next sees the tile distances
+	void dispatch() {
+		if (!m_Shader) return;
+
+		m_Shader->use();
+		m_Shader->dispatchPixels(m_Targets.width(m_Target), m_Targets.height(m_Target));
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+private:
+	SceneVariants m_Variants;
+	ComputeShader* m_Shader = nullptr;
+	RenderTargetPool& m_Targets;
+	int m_Target;
+};
+
+#endif //CONE_PREPASS_H
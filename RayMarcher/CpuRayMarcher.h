@@ -0,0 +1,296 @@
+#ifndef CPU_RAY_MARCHER_H
+#define CPU_RAY_MARCHER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Scene.h"
+#include "SimdMarch.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+// CPU reference implementation of compute.glsl. Fills an RGBA32F image with the
+// same layout as the GPU texture, so it can be uploaded with glTexSubImage2D.
+class CpuRayMarcher {
+public:
+	static constexpr float EPSILON = 0.001f;
+	static constexpr int MAX_ITERATIONS = 64;
+	static constexpr float MAX_DIST = 1000000.0f;
+	static constexpr unsigned TILE_SIZE = 16;
+	// Match SHADOW_BIAS, SHADOW_CUTOFF, AO_DISTANCE and AO_SAMPLES in shading.glsl.
+	// The GPU marches its shadow and AO rays through marchSDF, which with a distance
+	// volume or brick map is a lower bound rather than sceneSDF, so there penumbrae
+	// and occlusion come out somewhat darker than in this exact reference.
+	static constexpr float SHADOW_BIAS = 4.0f;
+	static constexpr float SHADOW_CUTOFF = 0.01f;
+	static constexpr float AO_DISTANCE = 0.5f;
+	static constexpr int AO_SAMPLES = 5;
+
+	CpuRayMarcher(unsigned width, unsigned height, unsigned threadCount = std::thread::hardware_concurrency())
+		: m_Pool(threadCount) {
+		resize(width, height);
+		setIsa(DetectSimdIsa());
+	}
+
+	// Picks the packet width used for marching; requests above what the CPU supports are clamped
+	void setIsa(SimdIsa isa) {
+		m_Isa = std::min(isa, DetectSimdIsa());
+		m_MarchPackets = SelectMarchPackets(m_Isa);
+	}
+
+	SimdIsa isa() const { return m_Isa; }
+
+	// Scales the pixel footprint used as hit tolerance far from the camera, 0 keeps EPSILON everywhere
+	void setFootprint(float footprint) {
+		m_Footprint = footprint;
+	}
+
+	// Step budget of each shadow ray (0 turns shadows off) and penumbra scale, see softShadow in shading.glsl
+	void setShadows(int iterations, float softness) {
+		m_ShadowIterations = iterations;
+		m_ShadowSoftness = softness;
+	}
+
+	// Copies the scene BVH; takes effect from the next render()
+	void setScene(const Scene& scene) {
+		m_SceneOps = scene.bvhOps();
+		m_SceneNodes = scene.bvhNodes();
+	}
+
+	void resize(unsigned width, unsigned height) {
+		m_Width = width;
+		m_Height = height;
+		m_Image.assign(4 * (size_t)width * height, 0.0f);
+	}
+
+	void render(const glm::mat4& cameraToWorld, const glm::mat4& invProjection) {
+		PROFILE_SCOPE("cpu render");
+		auto start = std::chrono::high_resolution_clock::now();
+		m_PixelRadius = m_Footprint * invProjection[1][1] / m_Height;
+
+		unsigned tilesX = (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+		unsigned tilesY = (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+		std::atomic<uint64_t> steps{ 0 };
+
+		m_Pool.parallelFor(tilesX * tilesY, [&](unsigned tile) {
+			unsigned x0 = (tile % tilesX) * TILE_SIZE;
+			unsigned y0 = (tile / tilesX) * TILE_SIZE;
+			unsigned x1 = std::min(x0 + TILE_SIZE, m_Width);
+			unsigned y1 = std::min(y0 + TILE_SIZE, m_Height);
+
+			uint64_t tileSteps = 0;
+			for (unsigned y = y0; y < y1; y++) {
+				if (m_MarchPackets) {
+					tileSteps += renderRowPacketed(x0, x1, y, cameraToWorld, invProjection);
+				}
+				else {
+					for (unsigned x = x0; x < x1; x++) {
+						tileSteps += renderPixel(x, y, cameraToWorld, invProjection);
+					}
+				}
+			}
+			steps += tileSteps;
+		});
+
+		auto end = std::chrono::high_resolution_clock::now();
+		m_FrameSeconds = std::chrono::duration<double>(end - start).count();
+		m_FrameSteps = steps;
+	}
+
+	const float* data() const { return m_Image.data(); }
+	unsigned width() const { return m_Width; }
+	unsigned height() const { return m_Height; }
+	unsigned threadCount() const { return m_Pool.size(); }
+
+	double frameSeconds() const { return m_FrameSeconds; }
+	uint64_t frameRays() const { return (uint64_t)m_Width * m_Height; }
+	uint64_t frameSteps() const { return m_FrameSteps; }
+	double raysPerSecond() const { return m_FrameSeconds > 0.0 ? frameRays() / m_FrameSeconds : 0.0; }
+
+	float sceneSDF(glm::vec3 p) const {
+		return Scene::evaluate(m_SceneNodes.data(), m_SceneNodes.size(), m_SceneOps.data(), p);
+	}
+
+	// Hit tolerance at distance t, see hitEpsilon in scene.glsl
+	float hitEpsilon(float t) const {
+		return std::max(EPSILON, m_PixelRadius * t);
+	}
+
+	// Analytic normal from the scene gradient, see estimateNormal in shading.glsl
+	glm::vec3 estimateNormal(glm::vec3 p, float eps) const {
+		glm::vec3 gradient = glm::vec3(Scene::gradient(m_SceneNodes.data(), m_SceneNodes.size(), m_SceneOps.data(), p));
+		if (glm::dot(gradient, gradient) > 0.0f) {
+			return glm::normalize(gradient);
+		}
+		return tetrahedralNormal(p, eps);
+	}
+
+	// Four samples on the corners of a tetrahedron instead of six central differences
+	glm::vec3 tetrahedralNormal(glm::vec3 p, float eps) const {
+		const glm::vec3 a(1, -1, -1), b(-1, -1, 1), c(-1, 1, -1), d(1, 1, 1);
+		return glm::normalize(a * sceneSDF(p + eps * a) + b * sceneSDF(p + eps * b) + c * sceneSDF(p + eps * c) + d * sceneSDF(p + eps * d));
+	}
+
+	// Returns the hit distance (MAX_DIST on a miss) and the number of steps taken
+	float rayMarch(glm::vec3 origin, glm::vec3 direction, int& steps) const {
+		float travelledDist = 0;
+		glm::vec3 position = origin;
+		for (steps = 1; steps <= MAX_ITERATIONS; steps++) {
+			float closestDist = sceneSDF(position);
+			travelledDist += closestDist;
+
+			if (closestDist < hitEpsilon(travelledDist)) {
+				return travelledDist;
+			} else if (travelledDist > MAX_DIST) {
+				return MAX_DIST;
+			}
+
+			position += closestDist * direction;
+		}
+		steps = MAX_ITERATIONS;
+		return MAX_DIST;
+	}
+
+	// Share of the light at lightDist that p sees, see softShadow in shading.glsl
+	float softShadow(glm::vec3 p, glm::vec3 direction, float lightDist, float eps) const {
+		float visibility = 1.0f;
+		float t = SHADOW_BIAS * eps;
+		for (int i = 0; i < m_ShadowIterations; i++) {
+			float dist = sceneSDF(p + t * direction);
+
+			visibility = std::min(visibility, m_ShadowSoftness * dist / t);
+			if (visibility < SHADOW_CUTOFF) {
+				return 0.0f;
+			}
+			if (dist >= lightDist - t) {
+				break;
+			}
+			t += std::max(dist, eps);
+		}
+		return glm::smoothstep(0.0f, 1.0f, visibility);
+	}
+
+	// Share of the ambient light that reaches p, see ambientOcclusion in shading.glsl
+	float ambientOcclusion(glm::vec3 p, glm::vec3 normal, float eps) const {
+		float occlusion = 0.0f;
+		float weight = 1.0f;
+		float totalWeight = 0.0f;
+		for (int i = 1; i <= AO_SAMPLES; i++) {
+			float h = SHADOW_BIAS * eps + AO_DISTANCE * i / AO_SAMPLES;
+			float dist = sceneSDF(p + h * normal);
+			occlusion += weight * glm::clamp((h - dist) / h, 0.0f, 1.0f);
+			totalWeight += weight;
+			weight *= 0.5f;
+		}
+		return 1.0f - occlusion / totalWeight;
+	}
+
+	// Traces every pixel's lighting, there is no light cache on the CPU
+	glm::vec4 shading(glm::vec3 origin, glm::vec3 direction, float dist) const {
+		if (dist == MAX_DIST) {
+			return glm::vec4(0.7f, 0.7f, 0.9f, 1.0f);
+		}
+
+		glm::vec3 p = origin + dist * direction;
+
+		const int numLights = 3;
+		const glm::vec3 light[numLights] = { glm::vec3(4, 10, -10), glm::vec3(4, 10, 10), glm::vec3(-5, 10, 10) };
+
+		float eps = hitEpsilon(dist);
+		glm::vec3 normal = estimateNormal(p, eps);
+
+		glm::vec4 color(ambientOcclusion(p, normal, eps) * glm::vec3(0.06f, 0.08f, 0.2f), 0.0f);
+		for (int i = 0; i < numLights; i++) {
+			glm::vec3 toLight = light[i] - p;
+			float lightDist = glm::length(toLight);
+			float diffuse = glm::dot(toLight / lightDist, normal);
+			if (diffuse > 0.0f && m_ShadowIterations > 0) {
+				diffuse *= softShadow(p, toLight / lightDist, lightDist, eps);
+			}
+			color += glm::vec4(glm::max(diffuse, 0.0f) * glm::vec3(0.3f, 0.4f, 1.0f), 1.0f);
+		}
+		return color;
+	}
+
+private:
+	ThreadPool m_Pool;
+	std::vector<float> m_Image;
+	unsigned m_Width = 0;
+	unsigned m_Height = 0;
+
+	std::vector<SceneOp> m_SceneOps;
+	std::vector<SceneBvhNode> m_SceneNodes;
+
+	float m_Footprint = 1.0f;
+	float m_PixelRadius = 0.0f;
+	int m_ShadowIterations = 32;
+	float m_ShadowSoftness = 8.0f;
+
+	SimdIsa m_Isa = ISA_SCALAR;
+	MarchPacketsFn m_MarchPackets = nullptr;
+
+	double m_FrameSeconds = 0.0;
+	uint64_t m_FrameSteps = 0;
+
+	glm::vec3 rayDirection(unsigned x, unsigned y, const glm::mat4& cameraToWorld, const glm::mat4& invProjection) const {
+		glm::vec3 direction = glm::vec3(invProjection * glm::vec4(2.0f * x / m_Width - 1, 2.0f * y / m_Height - 1, 0, 1));
+		return glm::normalize(glm::vec3(cameraToWorld * glm::vec4(direction, 0)));
+	}
+
+	void storePixel(unsigned x, unsigned y, const glm::vec4& color) {
+		float* pixel = &m_Image[4 * ((size_t)y * m_Width + x)];
+		pixel[0] = color.r;
+		pixel[1] = color.g;
+		pixel[2] = color.b;
+		pixel[3] = color.a;
+	}
+
+	int renderPixel(unsigned x, unsigned y, const glm::mat4& cameraToWorld, const glm::mat4& invProjection) {
+		glm::vec3 origin = glm::vec3(cameraToWorld * glm::vec4(0, 0, 0, 1));
+		glm::vec3 direction = rayDirection(x, y, cameraToWorld, invProjection);
+
+		int steps;
+		float dist = rayMarch(origin, direction, steps);
+		storePixel(x, y, shading(origin, direction, dist));
+		return steps;
+	}
+
+	// Marches a row segment of at most TILE_SIZE pixels with the packet kernel, then shades per pixel
+	uint64_t renderRowPacketed(unsigned x0, unsigned x1, unsigned y, const glm::mat4& cameraToWorld, const glm::mat4& invProjection) {
+		float ox[TILE_SIZE], oy[TILE_SIZE], oz[TILE_SIZE];
+		float dx[TILE_SIZE], dy[TILE_SIZE], dz[TILE_SIZE];
+		float dist[TILE_SIZE];
+		int steps[TILE_SIZE];
+
+		glm::vec3 origin = glm::vec3(cameraToWorld * glm::vec4(0, 0, 0, 1));
+		unsigned count = x1 - x0;
+		for (unsigned i = 0; i < count; i++) {
+			glm::vec3 direction = rayDirection(x0 + i, y, cameraToWorld, invProjection);
+			ox[i] = origin.x;
+			oy[i] = origin.y;
+			oz[i] = origin.z;
+			dx[i] = direction.x;
+			dy[i] = direction.y;
+			dz[i] = direction.z;
+		}
+
+		RayStream rays = { ox, oy, oz, dx, dy, dz, dist, steps, count, m_SceneOps.data(), m_SceneNodes.data(), (unsigned)m_SceneNodes.size(),
+			m_PixelRadius };
+		m_MarchPackets(rays);
+
+		uint64_t rowSteps = 0;
+		for (unsigned i = 0; i < count; i++) {
+			glm::vec3 direction(dx[i], dy[i], dz[i]);
+			storePixel(x0 + i, y, shading(origin, direction, dist[i]));
+			rowSteps += steps[i];
+		}
+		return rowSteps;
+	}
+};
+
+#endif //CPU_RAY_MARCHER_H
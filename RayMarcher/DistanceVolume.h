@@ -0,0 +1,179 @@
+#ifndef DISTANCE_VOLUME_H
+#define DISTANCE_VOLUME_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FrameParams.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+// sceneSDF baked into an R16F 3D texture over the scene bounds. scene.glsl
+// marches with trilinear samples of it, lowered by the interpolation and half
+// precision error so they stay conservative, and switches to the exact
+// sceneSDF close to surfaces. Bakes are cached on disk per scene hash and
+// resolution.
+class DistanceVolume {
+public:
+	DistanceVolume(GLuint unit) : m_Unit(unit) {}
+
+	~DistanceVolume() {
+		if (m_Texture) glDeleteTextures(1, &m_Texture);
+	}
+
+	DistanceVolume(const DistanceVolume&) = delete;
+	DistanceVolume& operator=(const DistanceVolume&) = delete;
+
+	static void setDirectory(const std::string& directory) {
+		s_Directory = directory;
+	}
+
+	// Loads the volume for scene from the cache, or bakes and caches it. resolution
+	// is the voxel count along the longest axis of the scene bounds.
+	bool build(const Scene& scene, unsigned resolution) {
+		m_Valid = false;
+		if (scene.bvhNodes().empty() || resolution < MIN_RESOLUTION) return false;
+
+		std::string cachePath = path(scene.hash(), resolution);
+		if (!load(cachePath)) {
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!bake(scene, resolution)) return false;
+			auto end = std::chrono::high_resolution_clock::now();
+
+			std::cout << "Baked " << m_Dims.x << "x" << m_Dims.y << "x" << m_Dims.z << " distance volume in "
+				<< std::chrono::duration<double>(end - start).count() << " s" << std::endl;
+			save(cachePath);
+		}
+		else {
+			std::cout << "Loaded " << m_Dims.x << "x" << m_Dims.y << "x" << m_Dims.z << " distance volume from " << cachePath << std::endl;
+		}
+
+		upload();
+		m_Valid = true;
+		return true;
+	}
+
+	// Fills the volume fields of params; the volume is only sampled if enabled and
+	// the last build() succeeded
+	void apply(FrameParams& params, bool enabled) const {
+		glm::vec3 cell = m_Valid ? (m_Max - m_Min) / glm::vec3(m_Dims) : glm::vec3(0.0f);
+		params.useVolume = enabled && m_Valid ? 1 : 0;
+		params.volumeMin = m_Min;
+		params.volumeMax = m_Max;
+		params.volumeError = glm::length(cell);
+	}
+
+	glm::uvec3 dims() const { return m_Dims; }
+
+private:
+	static constexpr const char* MAGIC = "RMDV";
+	static const unsigned MIN_RESOLUTION = 8;
+	static const unsigned MAX_RESOLUTION = 1024;
+	static inline std::string s_Directory = "volume_cache";
+
+	GLuint m_Unit;
+	GLuint m_Texture = 0;
+	bool m_Valid = false;
+	glm::uvec3 m_Dims = glm::uvec3(0);
+	glm::vec3 m_Min = glm::vec3(0.0f);
+	glm::vec3 m_Max = glm::vec3(0.0f);
+	std::vector<float> m_Distances;
+
+	bool bake(const Scene& scene, unsigned resolution) {
+		const SceneBvhNode& root = scene.bvhNodes()[0];
+		glm::vec3 extent = root.max - root.min;
+		float longest = glm::max(extent.x, glm::max(extent.y, extent.z));
+		if (!(longest > 0.0f)) return false;
+
+		resolution = glm::min(resolution, MAX_RESOLUTION);
+
+		// Two voxels of padding so samples next to the surfaces are never clamped
+		float cell = longest / (resolution - 4);
+		for (int axis = 0; axis < 3; axis++) {
+			m_Dims[axis] = glm::max(2u, (unsigned)std::ceil(extent[axis] / cell) + 4);
+		}
+		glm::vec3 center = 0.5f * (root.min + root.max);
+		m_Min = center - 0.5f * cell * glm::vec3(m_Dims);
+		m_Max = center + 0.5f * cell * glm::vec3(m_Dims);
+
+		m_Distances.assign((size_t)m_Dims.x * m_Dims.y * m_Dims.z, 0.0f);
+
+		ThreadPool pool;
+		pool.parallelFor(m_Dims.z * m_Dims.y, [&](unsigned row) {
+			unsigned y = row % m_Dims.y;
+			unsigned z = row / m_Dims.y;
+			float* out = &m_Distances[(size_t)row * m_Dims.x];
+			for (unsigned x = 0; x < m_Dims.x; x++) {
+				glm::vec3 p = m_Min + cell * (glm::vec3(x, y, z) + 0.5f);
+				out[x] = scene.evaluate(p);
+			}
+		});
+		return true;
+	}
+
+	void upload() {
+		if (!m_Texture) glGenTextures(1, &m_Texture);
+
+		glActiveTexture(GL_TEXTURE0 + m_Unit);
+		glBindTexture(GL_TEXTURE_3D, m_Texture);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, m_Dims.x, m_Dims.y, m_Dims.z, 0, GL_RED, GL_FLOAT, m_Distances.data());
+		glActiveTexture(GL_TEXTURE0);
+
+		m_Distances.clear();
+		m_Distances.shrink_to_fit();
+	}
+
+	bool load(const std::string& cachePath) {
+		std::ifstream file(cachePath, std::ios::binary);
+		if (!file) return false;
+
+		char magic[4];
+		file.read(magic, 4);
+		file.read((char*)&m_Dims, sizeof(m_Dims));
+		file.read((char*)&m_Min, sizeof(m_Min));
+		file.read((char*)&m_Max, sizeof(m_Max));
+		if (!file || std::string(magic, 4) != MAGIC) return false;
+		if (m_Dims.x < 2 || m_Dims.y < 2 || m_Dims.z < 2 || glm::max(m_Dims.x, glm::max(m_Dims.y, m_Dims.z)) > MAX_RESOLUTION) return false;
+
+		m_Distances.resize((size_t)m_Dims.x * m_Dims.y * m_Dims.z);
+		file.read((char*)m_Distances.data(), m_Distances.size() * sizeof(float));
+		return (bool)file;
+	}
+
+	void save(const std::string& cachePath) const {
+		std::error_code error;
+		std::filesystem::create_directories(s_Directory, error);
+
+		std::ofstream file(cachePath, std::ios::binary);
+		file.write(MAGIC, 4);
+		file.write((const char*)&m_Dims, sizeof(m_Dims));
+		file.write((const char*)&m_Min, sizeof(m_Min));
+		file.write((const char*)&m_Max, sizeof(m_Max));
+		file.write((const char*)m_Distances.data(), m_Distances.size() * sizeof(float));
+		if (!file) {
+			std::cout << "Distance volume: failed to write " << cachePath << std::endl;
+		}
+	}
+
+	static std::string path(uint64_t sceneHash, unsigned resolution) {
+		std::ostringstream name;
+		name << s_Directory << "/" << std::hex << sceneHash << std::dec << "_" << resolution << ".bin";
+		return name.str();
+	}
+};
+
+#endif //DISTANCE_VOLUME_H
@@ -0,0 +1,47 @@
+#ifndef FRAME_PARAMS_H
+#define FRAME_PARAMS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Per-frame parameters shared with scene.glsl. The layout has to match the
+// std140 FrameParams block declared there, field for field.
+struct FrameParams {
+	glm::mat4 cameraToWorld = glm::mat4(1.0f);
+	glm::mat4 invProjection = glm::mat4(1.0f);
+	glm::vec2 resolution = glm::vec2(0.0f);
+	float time = 0.0f;
+	float epsilon = 0.001f;
+	int32_t maxIterations = 64;
+	uint32_t countSteps = 0;
+	uint32_t useVolume = 0;
+	uint32_t padding0 = 0;
+	glm::vec3 volumeMin = glm::vec3(0.0f);
+	float volumeError = 0.0f;
+	glm::vec3 volumeMax = glm::vec3(0.0f);
+	uint32_t useBricks = 0;
+	glm::vec3 brickMin = glm::vec3(0.0f);
+	float brickCell = 0.0f;
+	uint32_t useCone = 0;
+	uint32_t useReprojection = 0;
+	float relaxation = 1.0f;
+	float footprint = 1.0f;
+	glm::mat4 prevCameraToWorld = glm::mat4(1.0f);
+	glm::mat4 worldToClip = glm::mat4(1.0f);
+	glm::vec2 jitter = glm::vec2(0.0f);
+	uint32_t useAccumulation = 0;
+	uint32_t accumulatedFrames = 0;
+	int32_t shadowIterations = 32;
+	float shadowSoftness = 8.0f;
+	uint32_t useLightCache = 0;
+	uint32_t lightCacheMask = 0;
+	uint32_t lightCacheFrame = 0;
+	float lightCacheCell = 0.0f;
+	uint32_t padding1 = 0;
+	uint32_t padding2 = 0;
+};
+
+static_assert(sizeof(FrameParams) == 400, "FrameParams must match the std140 layout in scene.glsl");
+
+#endif //FRAME_PARAMS_H
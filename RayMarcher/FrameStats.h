@@ -0,0 +1,120 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+
+// Collects per-frame timings of a benchmark run and summarises them
+class FrameStats {
+public:
+	void add(double seconds, uint64_t rays, uint64_t steps) {
+		m_FrameSeconds.push_back(seconds);
+		m_Rays += rays;
+		m_Steps += steps;
+	}
+
+	// A reference render of a measured frame and the squared error of the measured
+	// image against it, summed over all channels
+	void addReference(uint64_t rays, uint64_t steps, double squaredError, uint64_t values) {
+		m_ReferenceRays += rays;
+		m_ReferenceSteps += steps;
+		m_SquaredError += squaredError;
+		m_ErrorValues += values;
+	}
+
+	size_t frames() const { return m_FrameSeconds.size(); }
+
+	double meanMs() const {
+		if (m_FrameSeconds.empty()) return 0.0;
+		double total = 0.0;
+		for (double s : m_FrameSeconds) total += s;
+		return total * 1000.0 / m_FrameSeconds.size();
+	}
+
+	// Nearest-rank percentile, p in [0, 100]
+	double percentileMs(double p) const {
+		if (m_FrameSeconds.empty()) return 0.0;
+		std::vector<double> sorted = m_FrameSeconds;
+		std::sort(sorted.begin(), sorted.end());
+		size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+		rank = std::min(std::max(rank, (size_t)1), sorted.size());
+		return sorted[rank - 1] * 1000.0;
+	}
+
+	double raysPerSecond() const {
+		double total = meanMs() * frames() / 1000.0;
+		return total > 0.0 ? m_Rays / total : 0.0;
+	}
+
+	double stepsPerRay() const {
+		return m_Rays > 0 ? double(m_Steps) / m_Rays : 0.0;
+	}
+
+	bool hasReference() const {
+		return m_ReferenceRays > 0;
+	}
+
+	double referenceStepsPerRay() const {
+		return m_ReferenceRays > 0 ? double(m_ReferenceSteps) / m_ReferenceRays : 0.0;
+	}
+
+	double rmse() const {
+		return m_ErrorValues > 0 ? std::sqrt(m_SquaredError / m_ErrorValues) : 0.0;
+	}
+
+	void print(std::ostream& out) const {
+		out << std::fixed << std::setprecision(3)
+			<< "Frames: " << frames() << "\n"
+			<< "Frame time (ms): mean " << meanMs() << ", p50 " << percentileMs(50) << ", p95 " << percentileMs(95) << ", p99 " << percentileMs(99) << "\n"
+			<< "Rays/sec: " << raysPerSecond() / 1e6 << " M\n"
+			<< "Steps/ray: " << stepsPerRay() << std::endl;
+		if (hasReference()) {
+			out << "Reference steps/ray: " << referenceStepsPerRay() << ", image RMSE: " << std::setprecision(6) << rmse() << std::endl;
+		}
+	}
+
+	// `info` is written verbatim as extra top-level fields, e.g. "\"backend\": \"gpu\""
+	bool writeJson(const std::string& path, const std::vector<std::string>& info) const {
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file << std::fixed << std::setprecision(4) << "{\n";
+		for (const std::string& field : info) {
+			file << "  " << field << ",\n";
+		}
+		file << "  \"frames\": " << frames() << ",\n"
+			<< "  \"frame_ms\": { \"mean\": " << meanMs() << ", \"p50\": " << percentileMs(50)
+			<< ", \"p95\": " << percentileMs(95) << ", \"p99\": " << percentileMs(99) << " },\n"
+			<< "  \"rays_per_second\": " << raysPerSecond() << ",\n"
+			<< "  \"steps_per_ray\": " << stepsPerRay() << ",\n";
+		if (hasReference()) {
+			file << "  \"reference\": { \"steps_per_ray\": " << referenceStepsPerRay() << ", \"rmse\": " << std::setprecision(6) << rmse()
+				<< std::setprecision(4) << " },\n";
+		}
+		file << "  \"frame_times_ms\": [";
+		for (size_t i = 0; i < m_FrameSeconds.size(); i++) {
+			file << (i ? ", " : "") << m_FrameSeconds[i] * 1000.0;
+		}
+		file << "]\n}\n";
+		return (bool)file;
+	}
+
+private:
+	std::vector<double> m_FrameSeconds;
+	uint64_t m_Rays = 0;
+	uint64_t m_Steps = 0;
+	uint64_t m_ReferenceRays = 0;
+	uint64_t m_ReferenceSteps = 0;
+	double m_SquaredError = 0.0;
+	uint64_t m_ErrorValues = 0;
+};
+
+#endif //FRAME_STATS_H
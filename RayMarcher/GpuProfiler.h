@@ -0,0 +1,244 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+#include "Trace.h"
+
+// Times named GPU passes with GL_TIMESTAMP queries. Each frame's queries go into
+// one slot of a ring of FRAME_LATENCY slots and are read back when the slot comes
+// around again, by which time the GPU has long finished them, so the CPU never
+// waits. Timestamps rather than GL_TIME_ELAPSED because elapsed queries can't
+// nest and the quality governor already has one open around the ray march.
+// Every pass keeps its last HISTORY times for rolling statistics.
+class GpuProfiler {
+public:
+	struct PassStats {
+		std::string name;
+		size_t samples;
+		double lastMs;
+		double meanMs;
+		double minMs;
+		double maxMs;
+		double p95Ms;
+	};
+
+	GpuProfiler() {
+		for (Frame& frame : m_Frames) {
+			glGenQueries(2 * MAX_PASSES, frame.queries);
+		}
+	}
+
+	~GpuProfiler() {
+		for (Frame& frame : m_Frames) {
+			glDeleteQueries(2 * MAX_PASSES, frame.queries);
+		}
+	}
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// Lines GL_TIMESTAMP values up with the CPU events of the trace; needs a current
+	// context. The GL clock reads the time the command reaches the GPU, which is
+	// close enough to line passes up with the frame that issued them.
+	static void calibrateTrace() {
+		if (!Trace::enabled()) return;
+		GLint64 gpu = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu);
+		Trace::calibrateGpu(gpu);
+	}
+
+	// Reads back finished frames and starts recording a new one, unless the GPU is
+	// so far behind that the slot it would use is still in flight
+	void beginFrame() {
+		collect(false);
+		// A slot still in flight keeps its count until collect reads its queries
+		m_Recording = !m_Frames[m_Next].pending;
+		if (m_Recording) {
+			m_Frames[m_Next].count = 0;
+		}
+		m_Open.clear();
+	}
+
+	void endFrame() {
+		if (!m_Recording) return;
+		while (!m_Open.empty()) end();
+		m_Frames[m_Next].pending = m_Frames[m_Next].count > 0;
+		m_Next = (m_Next + 1) % FRAME_LATENCY;
+		m_Recording = false;
+	}
+
+	// Brackets one pass; passes may nest, a pass past MAX_PASSES in a frame is not timed
+	void begin(const char* name) {
+		Frame& frame = m_Frames[m_Next];
+		if (!m_Recording || frame.count == MAX_PASSES) {
+			m_Open.push_back(-1);
+			return;
+		}
+
+		int entry = frame.count++;
+		frame.passes[entry] = passIndex(name);
+		glQueryCounter(frame.queries[2 * entry], GL_TIMESTAMP);
+		frame.last = 2 * entry;
+		m_Open.push_back(entry);
+	}
+
+	void end() {
+		if (m_Open.empty()) return;
+		int entry = m_Open.back();
+		m_Open.pop_back();
+		if (entry >= 0) {
+			Frame& frame = m_Frames[m_Next];
+			glQueryCounter(frame.queries[2 * entry + 1], GL_TIMESTAMP);
+			frame.last = 2 * entry + 1;
+		}
+	}
+
+	// Blocks until every recorded frame is read back, for the end of a run
+	void flush() {
+		collect(true);
+	}
+
+	std::vector<PassStats> stats() const {
+		std::vector<PassStats> result;
+		for (const Pass& pass : m_Passes) {
+			if (pass.history.empty()) continue;
+
+			std::vector<double> sorted = pass.history;
+			std::sort(sorted.begin(), sorted.end());
+			double total = 0.0;
+			for (double ms : sorted) total += ms;
+			size_t rank = std::max((size_t)std::ceil(0.95 * sorted.size()), (size_t)1);
+
+			result.push_back({ pass.name, pass.samples, pass.history[(pass.next + pass.history.size() - 1) % pass.history.size()],
+				total / sorted.size(), sorted.front(), sorted.back(), sorted[rank - 1] });
+		}
+		return result;
+	}
+
+	// Mean time of every pass on one line, e.g. for the window title
+	std::string summary() const {
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(2);
+		for (const PassStats& pass : stats()) {
+			out << pass.name << " " << pass.meanMs << " ";
+		}
+		out << "ms";
+		return out.str();
+	}
+
+	// A JSON object for FrameStats::writeJson's info fields
+	std::string json() const {
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(4) << "\"gpu_passes_ms\": {";
+		std::vector<PassStats> passes = stats();
+		for (size_t i = 0; i < passes.size(); i++) {
+			const PassStats& pass = passes[i];
+			out << (i ? ", " : " ") << JsonString(pass.name) << ": { \"mean\": " << pass.meanMs << ", \"min\": " << pass.minMs
+				<< ", \"max\": " << pass.maxMs << ", \"p95\": " << pass.p95Ms << " }";
+		}
+		out << " }";
+		return out.str();
+	}
+
+	// Writes the rolling statistics as CSV if path ends in .csv, else as JSON
+	bool write(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) return false;
+
+		bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+		if (csv) {
+			file << std::fixed << std::setprecision(4) << "pass,samples,last_ms,mean_ms,min_ms,max_ms,p95_ms\n";
+			for (const PassStats& pass : stats()) {
+				file << pass.name << "," << pass.samples << "," << pass.lastMs << "," << pass.meanMs << ","
+					<< pass.minMs << "," << pass.maxMs << "," << pass.p95Ms << "\n";
+			}
+		}
+		else {
+			file << "{ " << json() << " }\n";
+		}
+		return (bool)file;
+	}
+
+private:
+	static const int FRAME_LATENCY = 4;
+	static const int MAX_PASSES = 8;
+	static const size_t HISTORY = 256;
+
+	struct Frame {
+		GLuint queries[2 * MAX_PASSES];
+		int passes[MAX_PASSES];
+		int count = 0;
+		// The query written last, available only once all others are
+		int last = 0;
+		bool pending = false;
+	};
+
+	struct Pass {
+		std::string name;
+		std::vector<double> history;
+		size_t next = 0;
+		size_t samples = 0;
+	};
+
+	Frame m_Frames[FRAME_LATENCY];
+	int m_Next = 0;
+	bool m_Recording = false;
+	std::vector<int> m_Open;
+	std::vector<Pass> m_Passes;
+
+	int passIndex(const char* name) {
+		for (size_t i = 0; i < m_Passes.size(); i++) {
+			if (m_Passes[i].name == name) return (int)i;
+		}
+		m_Passes.push_back({ name, {}, 0, 0 });
+		return (int)m_Passes.size() - 1;
+	}
+
+	// Reads pending frames oldest first; without wait it stops at the first one
+	// whose last timestamp isn't available yet
+	void collect(bool wait) {
+		for (int i = 0; i < FRAME_LATENCY; i++) {
+			Frame& frame = m_Frames[(m_Next + i) % FRAME_LATENCY];
+			if (!frame.pending) continue;
+
+			if (!wait) {
+				GLint available = 0;
+				glGetQueryObjectiv(frame.queries[frame.last], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available) break;
+			}
+
+			for (int entry = 0; entry < frame.count; entry++) {
+				GLuint64 begin = 0, end = 0;
+				glGetQueryObjectui64v(frame.queries[2 * entry], GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(frame.queries[2 * entry + 1], GL_QUERY_RESULT, &end);
+				Pass& pass = m_Passes[frame.passes[entry]];
+				record(pass, end > begin ? (end - begin) / 1e6 : 0.0);
+				if (Trace::enabled()) Trace::addGpu(pass.name, begin, end);
+			}
+			frame.pending = false;
+		}
+	}
+
+	void record(Pass& pass, double ms) {
+		if (pass.history.size() < HISTORY) {
+			pass.history.push_back(ms);
+		}
+		else {
+			pass.history[pass.next] = ms;
+		}
+		pass.next = (pass.next + 1) % HISTORY;
+		pass.samples++;
+	}
+};
+
+#endif //GPU_PROFILER_H
@@ -0,0 +1,23 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a; pass a previous result as hash to extend it
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline uint64_t HashBytes(const std::string& data, uint64_t hash = 14695981039346656037ull)
+{
+	return HashBytes(data.data(), data.size(), hash);
+}
+
+#endif //HASH_H
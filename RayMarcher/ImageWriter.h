@@ -0,0 +1,33 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes an RGBA32F image (bottom row first, as GL stores it) to a binary PPM.
+// Alpha is dropped and colours are clamped to [0, 1].
+inline bool WritePPM(const std::string& path, unsigned width, unsigned height, const float* rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	std::vector<unsigned char> row(3 * (size_t)width);
+	for (unsigned y = 0; y < height; y++) {
+		const float* src = rgba + 4 * (size_t)(height - 1 - y) * width;
+		for (unsigned x = 0; x < width; x++) {
+			for (int c = 0; c < 3; c++) {
+				float v = std::min(std::max(src[4 * x + c], 0.0f), 1.0f);
+				row[3 * x + c] = (unsigned char)std::lround(v * 255.0f);
+			}
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
+
+#endif //IMAGE_WRITER_H
@@ -0,0 +1,16 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+
+inline std::string JsonString(const std::string& value)
+{
+	std::string quoted = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+#endif //JSON_H
@@ -0,0 +1,86 @@
+#ifndef LIGHT_CACHE_H
+#define LIGHT_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "FrameParams.h"
+
+// Host side of lightcache.glsl: a fixed budget of hash grid cells in a shader
+// storage buffer that caches what the shading pass traces, the visibility of
+// every light and the ambient occlusion, across pixels and frames. The cells
+// fill in while the camera moves and are evicted least recently used first once
+// their probe sequence is full, so the memory never grows. The cache holds for
+// one distance function: a new scene has to invalidate() it, and switching the
+// distance volume or brick map, which the cached rays march, clears it too.
+class LightCache {
+public:
+	// std430 size of LightCacheCell
+	static const GLsizeiptr CELL_BYTES = 32;
+
+	// cells is rounded up to a power of two, 0 leaves the cache off; cellSize is
+	// the smallest cell in world units, used up close to the camera
+	LightCache(GLuint cells, float cellSize, GLuint binding) : m_CellSize(cellSize), m_Binding(binding) {
+		if (cells == 0) return;
+
+		m_Cells = 1;
+		while (m_Cells < cells) m_Cells <<= 1;
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, m_Cells * CELL_BYTES, NULL, GL_DYNAMIC_STORAGE_BIT);
+		invalidate();
+	}
+
+	~LightCache() {
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	LightCache(const LightCache&) = delete;
+	LightCache& operator=(const LightCache&) = delete;
+
+	// Forgets every cell, for a new scene
+	void invalidate() {
+		if (!m_Buffer) return;
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+
+	// Fills the light cache fields of params and binds the cells for the frame's
+	// shading pass, after volume and brick map have filled theirs. The frame count
+	// ages the cells for eviction.
+	void apply(FrameParams& params, bool enabled) {
+		// Full cells never refresh, values marched through the other SDF would stay
+		if (params.useVolume != m_UseVolume || params.useBricks != m_UseBricks) {
+			m_UseVolume = params.useVolume;
+			m_UseBricks = params.useBricks;
+			invalidate();
+		}
+
+		params.useLightCache = enabled && m_Buffer ? 1 : 0;
+		params.lightCacheMask = m_Cells - 1;
+		params.lightCacheFrame = ++m_Frame;
+		params.lightCacheCell = m_CellSize;
+		if (params.useLightCache) {
+			// The last frame's sums have to be visible to this frame's reads
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_Binding, m_Buffer);
+		}
+	}
+
+	GLuint cells() const { return m_Buffer ? m_Cells : 0; }
+	size_t bytes() const { return (size_t)cells() * CELL_BYTES; }
+
+private:
+	float m_CellSize;
+	GLuint m_Binding;
+	GLuint m_Buffer = 0;
+	GLuint m_Cells = 0;
+	GLuint m_Frame = 0;
+	uint32_t m_UseVolume = 0;
+	uint32_t m_UseBricks = 0;
+};
+
+#endif //LIGHT_CACHE_H
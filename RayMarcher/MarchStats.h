@@ -0,0 +1,225 @@
+#ifndef MARCH_STATS_H
+#define MARCH_STATS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ComputeShader.h"
+#include "RenderTargetPool.h"
+
+// Host side of the MARCH_STATS variants of compute.glsl and shading.glsl. Every
+// pixel stores its step count, termination reason and sceneSDF evaluations, the
+// shading pass's normals and shadow rays included, in an RG32UI target, and every
+// frame sums them into a counter buffer along with a histogram of step counts.
+// The counters are copied into a ring of persistently mapped buffers and read
+// back once their fence has signalled, a few frames late, so the CPU never waits.
+// heatmap.glsl draws the per pixel values over the image.
+class MarchStats {
+public:
+	static const unsigned BINS = 64;
+
+	enum Heatmap { HEATMAP_OFF, HEATMAP_STEPS, HEATMAP_EVALUATIONS, HEATMAP_COUNT };
+
+	struct Counters {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t exhausted = 0;
+		uint64_t evaluations = 0;
+		uint64_t histogram[BINS] = {};
+
+		uint64_t rays() const { return hits + misses + exhausted; }
+	};
+
+	// The defines are those of the plain ray march program, image formats included
+	MarchStats(const char* heatmapPath, const std::string& defines, RenderTargetPool& targets, GLuint imageUnit, GLuint binding)
+		: m_Heatmap(heatmapPath, defines), m_Binding(binding), m_Fences(SLOTS, nullptr) {
+		targets.add(GL_RG32UI, imageUnit);
+
+		glGenBuffers(1, &m_Counters);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Counters);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, sizeof(GpuCounters), NULL, GL_DYNAMIC_STORAGE_BIT);
+		// Bound from the start, so instrumented frames outside beginFrame and
+		// endFrame, e.g. a benchmark's warmup, count into it rather than nowhere
+		GLuint zero = 0;
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_Binding, m_Counters);
+
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &m_Readback);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_Readback);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, sizeof(GpuCounters) * SLOTS, NULL, flags);
+		m_Mapped = (const char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, sizeof(GpuCounters) * SLOTS, flags);
+	}
+
+	~MarchStats() {
+		for (GLsync fence : m_Fences) {
+			if (fence) glDeleteSync(fence);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_Readback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glDeleteBuffers(1, &m_Readback);
+		glDeleteBuffers(1, &m_Counters);
+		glDeleteProgram(m_Heatmap.m_ID);
+	}
+
+	MarchStats(const MarchStats&) = delete;
+	MarchStats& operator=(const MarchStats&) = delete;
+
+	// Defines that turn compute.glsl into the instrumented variant
+	static std::string defines() {
+		return ShaderDefine("MARCH_STATS", 1) + ShaderDefine("MARCH_STATS_BINS", BINS);
+	}
+
+	// Reads back every finished frame and zeroes the counters for the next one
+	void beginFrame() {
+		collect(false);
+
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Counters);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_Binding, m_Counters);
+	}
+
+	// After the instrumented ray march: queues the copy of this frame's counters,
+	// skipped if the GPU is so far behind that the next readback slot is in use
+	void endFrame(int maxIterations) {
+		unsigned slot = (m_Slot + 1) % SLOTS;
+		if (m_Fences[slot]) return;
+		m_Slot = slot;
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_Counters);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_Readback);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m_Slot * sizeof(GpuCounters), sizeof(GpuCounters));
+		m_Fences[m_Slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_MaxIterations[m_Slot] = maxIterations;
+	}
+
+	// Draws the per pixel statistics over the image of the frame just marched
+	void drawHeatmap(Heatmap mode, GLuint width, GLuint height) {
+		if (mode == HEATMAP_OFF) return;
+
+		m_Heatmap.use();
+		m_Heatmap.setInt("mode", mode);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		m_Heatmap.dispatchPixels(width, height);
+	}
+
+	// Blocks until every queued readback has arrived, for the end of a run
+	void flush() {
+		collect(true);
+	}
+
+	// The last frame read back, and the sum of all of them
+	const Counters& latest() const { return m_Latest; }
+	const Counters& total() const { return m_Total; }
+	int maxIterations() const { return m_LatestMaxIterations; }
+
+	// One line summary of counters
+	static std::string summary(const Counters& counters) {
+		double rays = (double)std::max(counters.rays(), (uint64_t)1);
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(2) << "Hit " << 100.0 * counters.hits / rays << "%, missed " << 100.0 * counters.misses / rays
+			<< "%, out of iterations " << 100.0 * counters.exhausted / rays << "%, " << counters.evaluations / rays << " SDF evaluations/ray";
+		return out.str();
+	}
+
+	// A JSON object for FrameStats::writeJson's info fields
+	static std::string json(const Counters& counters) {
+		std::ostringstream out;
+		out << "\"march_stats\": { \"hits\": " << counters.hits << ", \"misses\": " << counters.misses << ", \"exhausted\": " << counters.exhausted
+			<< ", \"evaluations\": " << counters.evaluations << ", \"histogram\": [";
+		for (unsigned i = 0; i < BINS; i++) {
+			out << (i ? ", " : "") << counters.histogram[i];
+		}
+		out << "] }";
+		return out.str();
+	}
+
+	// Step count histogram as CSV, one row per bin with its range of steps
+	static bool writeHistogram(const std::string& path, const Counters& counters, int maxIterations) {
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file << "first_step,last_step,rays,share\n";
+		double rays = (double)std::max(counters.rays(), (uint64_t)1);
+		for (unsigned i = 0; i < BINS; i++) {
+			// Inverse of the bin index in compute.glsl, (steps - 1) * BINS / maxIterations
+			unsigned first = (i * maxIterations + BINS - 1) / BINS + 1;
+			unsigned last = ((i + 1) * maxIterations + BINS - 1) / BINS;
+			if (first > last) continue;
+			file << first << "," << last << "," << counters.histogram[i] << "," << counters.histogram[i] / rays << "\n";
+		}
+		return (bool)file;
+	}
+
+private:
+	static const unsigned SLOTS = 3;
+
+	// std430 layout of MarchCounters
+	struct GpuCounters {
+		GLuint terminations[3];
+		GLuint evaluations;
+		GLuint histogram[BINS];
+	};
+
+	ComputeShader m_Heatmap;
+	GLuint m_Binding;
+	GLuint m_Counters = 0;
+	GLuint m_Readback = 0;
+	const char* m_Mapped = nullptr;
+	std::vector<GLsync> m_Fences;
+	int m_MaxIterations[SLOTS] = {};
+	unsigned m_Slot = 0;
+
+	Counters m_Latest;
+	Counters m_Total;
+	int m_LatestMaxIterations = 0;
+
+	// Oldest slot first, so latest ends up the newest frame
+	void collect(bool wait) {
+		for (unsigned i = 1; i <= SLOTS; i++) {
+			unsigned slot = (m_Slot + i) % SLOTS;
+			GLsync& fence = m_Fences[slot];
+			if (!fence) continue;
+
+			GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? ~GLuint64(0) : 0);
+			if (status == GL_TIMEOUT_EXPIRED) break;
+			glDeleteSync(fence);
+			fence = nullptr;
+
+			GpuCounters gpu;
+			std::memcpy(&gpu, m_Mapped + slot * sizeof(GpuCounters), sizeof(GpuCounters));
+			m_Latest = Counters();
+			m_Latest.hits = gpu.terminations[0];
+			m_Latest.misses = gpu.terminations[1];
+			m_Latest.exhausted = gpu.terminations[2];
+			m_Latest.evaluations = gpu.evaluations;
+			for (unsigned b = 0; b < BINS; b++) {
+				m_Latest.histogram[b] = gpu.histogram[b];
+			}
+			m_LatestMaxIterations = m_MaxIterations[slot];
+			add(m_Total, m_Latest);
+		}
+	}
+
+	static void add(Counters& total, const Counters& frame) {
+		total.hits += frame.hits;
+		total.misses += frame.misses;
+		total.exhausted += frame.exhausted;
+		total.evaluations += frame.evaluations;
+		for (unsigned b = 0; b < BINS; b++) {
+			total.histogram[b] += frame.histogram[b];
+		}
+	}
+};
+
+#endif //MARCH_STATS_H
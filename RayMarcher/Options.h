@@ -0,0 +1,243 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+struct Options {
+	bool headless = false;
+	unsigned width = 1280;
+	unsigned height = 720;
+	unsigned frames = 1;
+	unsigned threads = 0;
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, -10.0f);
+	float yaw = -90.0f;
+	float pitch = 0.0f;
+	std::string output = "frame";
+	std::string record;
+	std::string benchmark;
+	std::string json;
+	unsigned warmup = 5;
+	bool retune = false;
+	std::string scene;
+	std::string shaderDir;
+	bool dynamicScene = false;
+	unsigned volume = 0;
+	unsigned bricks = 0;
+	unsigned brickBudget = 256;
+	bool cone = true;
+	bool reprojection = true;
+	bool relaxed = false;
+	float relaxation = 1.6f;
+	bool comparePlain = false;
+	float frameBudget = 0.0f;
+	float footprint = 1.0f;
+	std::string format = "rgba32f";
+	std::string gpuProfile;
+	std::string trace;
+	std::string marchStats;
+	std::string idle = "accumulate";
+	int shadowIterations = 32;
+	float shadowSoftness = 8.0f;
+	unsigned lightCache = 1 << 18;
+	float lightCacheCell = 0.02f;
+};
+
+inline void PrintUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --headless              render without a window on the CPU backend\n"
+		<< "  --size <w> <h>          render resolution (default 1280 720)\n"
+		<< "  --frames <n>            number of frames to render (default 1)\n"
+		<< "  --threads <n>           CPU worker threads (default: all cores)\n"
+		<< "  --position <x> <y> <z>  camera position (default 0 0 -10)\n"
+		<< "  --yaw <deg>             camera yaw (default -90)\n"
+		<< "  --pitch <deg>           camera pitch (default 0)\n"
+		<< "  --output <prefix>       image file prefix (default frame)\n"
+		<< "  --record <file>         record the interactive camera path to a file\n"
+		<< "  --benchmark <file>      replay a recorded camera path without vsync and report frame statistics\n"
+		<< "  --warmup <n>            untimed frames before a benchmark (default 5)\n"
+		<< "  --json <file>           write benchmark results as JSON\n"
+		<< "  --retune                time compute workgroup sizes again instead of using the cached choice\n"
+		<< "  --scene <file>          scene description to render (default scene.txt next to the shaders)\n"
+		<< "  --shader-dir <dir>      where the shaders are (default the build's SHADER_DIR, else next to the executable)\n"
+		<< "  --dynamic-scene         walk the scene buffer on the GPU instead of compiling the scene into the shader\n"
+		<< "  --volume <n>            march through a baked n^3 distance volume away from surfaces (GPU only)\n"
+		<< "  --bricks <n>            march through a sparse brick map with n voxels along the longest axis (GPU only)\n"
+		<< "  --brick-budget <MB>     memory budget of the brick map atlas, lowers the resolution to fit (default 256)\n"
+		<< "  --no-cone               start every ray at the camera instead of after the cone marching prepass\n"
+		<< "  --no-reprojection       do not warm start rays from the previous frame's reprojected depth\n"
+		<< "  --relaxed               over-relaxed sphere tracing, steps stretched by the relaxation factor\n"
+		<< "  --relaxation <w>        over-relaxation factor in [1, 2), implies --relaxed (default 1.6)\n"
+		<< "  --compare-plain         also render every benchmark frame with plain sphere tracing and report its steps and the image error\n"
+		<< "  --frame-budget <ms>     lower resolution and ray march quality to keep GPU frames under the budget (default off)\n"
+		<< "  --footprint <k>         hit tolerance of k pixel footprints far from the camera, 0 for a fixed epsilon (default 1)\n"
+		<< "  --format <f>            storage of the GPU image: rgba32f, rgba16f, rgba8 or r11g11b10f (default rgba32f)\n"
+		<< "  --gpu-profile <file>    write per pass GPU times on exit, as CSV for a .csv file and JSON otherwise\n"
+		<< "  --trace <file>          record CPU scopes and GPU passes and write them on exit as a Chrome trace\n"
+		<< "  --march-stats <file>    run the instrumented ray march and write its step count histogram as CSV on exit\n"
+		<< "  --idle <mode>           frames with a still camera: off renders them, skip doesn't, accumulate averages\n"
+		<< "                          jittered samples for antialiasing, then skips (default accumulate)\n"
+		<< "  --shadow-iterations <n> step budget of each soft shadow ray, 0 turns shadows off (default 32)\n"
+		<< "  --shadow-softness <k>   penumbra scale, larger is harder (default 8)\n"
+		<< "  --light-cache <cells>   hash grid cells caching shadows and ambient occlusion, 32 bytes each, 0 turns it off (default 262144)\n"
+		<< "  --light-cache-cell <s>  smallest light cache cell in world units (default 0.02)\n";
+}
+
+// Returns false and prints the usage on malformed arguments
+inline bool ParseOptions(int argc, char** argv, Options& options)
+{
+	// The largest texture side GL 4.6 implementations commonly allow
+	const int MAX_SIZE = 16384;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto need = [&](int count) {
+			if (i + count >= argc) {
+				std::cout << "Missing value for " << arg << std::endl;
+				return false;
+			}
+			return true;
+		};
+
+		if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--size" && need(2)) {
+			// Parsed signed so that a negative size is rejected rather than wrapped
+			int width = std::atoi(argv[++i]);
+			int height = std::atoi(argv[++i]);
+			if (width <= 0 || height <= 0 || width > MAX_SIZE || height > MAX_SIZE) {
+				std::cout << "Resolution must be between 1 and " << MAX_SIZE << " on each side" << std::endl;
+				return false;
+			}
+			options.width = width;
+			options.height = height;
+		}
+		else if (arg == "--frames" && need(1)) {
+			options.frames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--threads" && need(1)) {
+			options.threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--position" && need(3)) {
+			options.position.x = (float)std::atof(argv[++i]);
+			options.position.y = (float)std::atof(argv[++i]);
+			options.position.z = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--yaw" && need(1)) {
+			options.yaw = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--pitch" && need(1)) {
+			options.pitch = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--output" && need(1)) {
+			options.output = argv[++i];
+		}
+		else if (arg == "--record" && need(1)) {
+			options.record = argv[++i];
+		}
+		else if (arg == "--benchmark" && need(1)) {
+			options.benchmark = argv[++i];
+		}
+		else if (arg == "--warmup" && need(1)) {
+			options.warmup = std::atoi(argv[++i]);
+		}
+		else if (arg == "--json" && need(1)) {
+			options.json = argv[++i];
+		}
+		else if (arg == "--retune") {
+			options.retune = true;
+		}
+		else if (arg == "--shader-dir" && need(1)) {
+			options.shaderDir = argv[++i];
+		}
+		else if (arg == "--scene" && need(1)) {
+			options.scene = argv[++i];
+		}
+		else if (arg == "--dynamic-scene") {
+			options.dynamicScene = true;
+		}
+		else if (arg == "--volume" && need(1)) {
+			options.volume = std::atoi(argv[++i]);
+		}
+		else if (arg == "--bricks" && need(1)) {
+			options.bricks = std::atoi(argv[++i]);
+		}
+		else if (arg == "--brick-budget" && need(1)) {
+			options.brickBudget = std::atoi(argv[++i]);
+		}
+		else if (arg == "--no-cone") {
+			options.cone = false;
+		}
+		else if (arg == "--no-reprojection") {
+			options.reprojection = false;
+		}
+		else if (arg == "--relaxed") {
+			options.relaxed = true;
+		}
+		else if (arg == "--relaxation" && need(1)) {
+			options.relaxed = true;
+			options.relaxation = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--compare-plain") {
+			options.comparePlain = true;
+		}
+		else if (arg == "--frame-budget" && need(1)) {
+			options.frameBudget = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--footprint" && need(1)) {
+			options.footprint = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--format" && need(1)) {
+			options.format = argv[++i];
+		}
+		else if (arg == "--gpu-profile" && need(1)) {
+			options.gpuProfile = argv[++i];
+		}
+		else if (arg == "--trace" && need(1)) {
+			options.trace = argv[++i];
+		}
+		else if (arg == "--march-stats" && need(1)) {
+			options.marchStats = argv[++i];
+		}
+		else if (arg == "--idle" && need(1)) {
+			options.idle = argv[++i];
+		}
+		else if (arg == "--shadow-iterations" && need(1)) {
+			options.shadowIterations = std::atoi(argv[++i]);
+		}
+		else if (arg == "--shadow-softness" && need(1)) {
+			options.shadowSoftness = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--light-cache" && need(1)) {
+			options.lightCache = std::atoi(argv[++i]);
+		}
+		else if (arg == "--light-cache-cell" && need(1)) {
+			options.lightCacheCell = (float)std::atof(argv[++i]);
+		}
+		else {
+			PrintUsage(argv[0]);
+			return false;
+		}
+	}
+
+	if (options.lightCache > (1u << 26) || !(options.lightCacheCell > 0.0f)) {
+		std::cout << "The light cache takes at most 2^26 cells of positive size" << std::endl;
+		return false;
+	}
+	if (options.shadowIterations < 0 || !(options.shadowSoftness > 0.0f)) {
+		std::cout << "Shadow iterations must be non-negative and softness positive" << std::endl;
+		return false;
+	}
+	if (!(options.relaxation >= 1.0f && options.relaxation < 2.0f)) {
+		std::cout << "Relaxation must be in [1, 2)" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#endif //OPTIONS_H
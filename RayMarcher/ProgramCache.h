@@ -0,0 +1,140 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+// Entries are keyed by a hash of the final shader sources, which already contain
+// any injected defines, and of the driver's vendor, renderer and version strings.
+class ProgramCache {
+public:
+	static void setDirectory(const std::string& directory) {
+		s_Directory = directory;
+	}
+
+	static uint64_t key(const std::vector<std::string>& sources) {
+		uint64_t hash = HashBytes(driverString());
+		for (const std::string& source : sources) {
+			hash = HashBytes(source, hash);
+			hash = HashBytes(std::string(1, '\0'), hash);
+		}
+		return hash;
+	}
+
+	// Tries to load the binary for `key` into `program`. Returns false if there is no
+	// entry or the driver rejects it, in which case the caller compiles from source.
+	static bool load(GLuint program, uint64_t key) {
+		if (!supported()) return false;
+
+		std::ifstream file(path(key), std::ios::binary);
+		if (!file) {
+			s_Misses++;
+			return false;
+		}
+
+		char magic[4];
+		GLenum format;
+		file.read(magic, 4);
+		file.read((char*)&format, sizeof(format));
+		if (!file || std::string(magic, 4) != MAGIC) {
+			s_Rejected++;
+			return false;
+		}
+
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (binary.empty()) {
+			s_Rejected++;
+			return false;
+		}
+
+		glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+
+		GLint success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			s_Rejected++;
+			return false;
+		}
+
+		s_Hits++;
+		return true;
+	}
+
+	// Call before linking so the driver keeps the binary around for store()
+	static void prepare(GLuint program) {
+		if (supported()) {
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+	}
+
+	static void store(GLuint program, uint64_t key) {
+		if (!supported()) return;
+
+		GLint success, length = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!success || length <= 0) return;
+
+		std::vector<char> binary(length);
+		GLenum format;
+		glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(s_Directory, error);
+
+		std::ofstream file(path(key), std::ios::binary);
+		file.write(MAGIC, 4);
+		file.write((const char*)&format, sizeof(format));
+		file.write(binary.data(), binary.size());
+		if (!file) {
+			std::cout << "Program cache: failed to write " << path(key) << std::endl;
+		}
+	}
+
+	static void printStats() {
+		std::cout << "Program cache: " << s_Hits << " hits, " << s_Misses << " misses, " << s_Rejected << " rejected" << std::endl;
+	}
+
+private:
+	static constexpr const char* MAGIC = "RMPB";
+
+	static inline std::string s_Directory = "shader_cache";
+	static inline unsigned s_Hits = 0;
+	static inline unsigned s_Misses = 0;
+	static inline unsigned s_Rejected = 0;
+
+	static bool supported() {
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	static std::string driverString() {
+		std::string driver;
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : names) {
+			const GLubyte* value = glGetString(name);
+			driver += value ? (const char*)value : "";
+			driver += '\n';
+		}
+		return driver;
+	}
+
+	static std::string path(uint64_t key) {
+		std::ostringstream name;
+		name << s_Directory << "/" << std::hex << key << ".bin";
+		return name.str();
+	}
+};
+
+#endif //PROGRAM_CACHE_H
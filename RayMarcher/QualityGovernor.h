@@ -0,0 +1,164 @@
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#include "FrameParams.h"
+
+// Holds the GPU time of a frame under a budget by trading image quality for
+// speed. The ray march is timed with GL_TIME_ELAPSED queries, read back a few
+// frames late so the CPU never waits on them. Whenever the smoothed time goes
+// over the budget the governor drops one quality level: fewer iterations, a
+// looser epsilon and then a lower render resolution, rendered into the top left
+// of the full size image and upscaled when drawn. It only climbs back after a
+// while comfortably under budget, so it does not oscillate between two levels.
+class QualityGovernor {
+public:
+	QualityGovernor(float budgetMs, GLuint width, GLuint height) : m_BudgetMs(budgetMs), m_Width(width), m_Height(height) {
+		glGenQueries(QUERY_COUNT, m_Queries);
+	}
+
+	~QualityGovernor() {
+		glDeleteQueries(QUERY_COUNT, m_Queries);
+	}
+
+	QualityGovernor(const QualityGovernor&) = delete;
+	QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+	// Full render size, level 0 renders at this resolution
+	void resize(GLuint width, GLuint height) {
+		m_Width = width;
+		m_Height = height;
+	}
+
+	// Brackets the GPU work of one frame
+	void beginFrame() {
+		collect();
+		if (m_Pending[m_Next]) return;
+		glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Next]);
+		m_Timing = true;
+	}
+
+	void endFrame() {
+		if (!m_Timing) return;
+		glEndQuery(GL_TIME_ELAPSED);
+		m_Pending[m_Next] = true;
+		m_Next = (m_Next + 1) % QUERY_COUNT;
+		m_Timing = false;
+	}
+
+	// Fills the resolution, iteration count and epsilon of the current level into
+	// params, based on the full quality maxIterations and epsilon. Returns true if
+	// the render resolution changed since the last call.
+	bool apply(FrameParams& params, int maxIterations, float epsilon) {
+		const Level& level = LEVELS[m_Level];
+		glm::vec2 resolution = renderSize();
+
+		bool resized = resolution != params.resolution;
+		params.resolution = resolution;
+		params.maxIterations = std::max(1, (int)(level.iterations * maxIterations));
+		params.epsilon = level.epsilon * epsilon;
+		return resized;
+	}
+
+	// Texture coordinate scale that maps the full screen quad to the rendered part
+	// of the image; the rendered size is rounded down, so not exactly the level's scale
+	glm::vec2 uvScale() const {
+		return renderSize() / glm::vec2(m_Width, m_Height);
+	}
+
+	int level() const { return m_Level; }
+	float smoothedMs() const { return m_SmoothedMs; }
+
+private:
+	struct Level {
+		float scale;
+		float iterations;
+		float epsilon;
+	};
+
+	static constexpr Level LEVELS[] = {
+		{ 1.0f, 1.0f, 1.0f },
+		{ 1.0f, 0.75f, 1.5f },
+		{ 0.85f, 0.75f, 1.5f },
+		{ 0.7f, 0.625f, 2.0f },
+		{ 0.6f, 0.5f, 2.0f },
+		{ 0.5f, 0.5f, 3.0f },
+	};
+	static const int LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+	static const int QUERY_COUNT = 4;
+	// Frames to wait after a change before the next one, so the average catches up
+	static const int SETTLE_FRAMES = 10;
+	// Frames in a row under RAISE_RATIO of the budget before quality goes back up
+	static const int RAISE_FRAMES = 60;
+	static constexpr float RAISE_RATIO = 0.7f;
+	static constexpr float SMOOTHING = 0.1f;
+
+	float m_BudgetMs;
+	GLuint m_Width;
+	GLuint m_Height;
+
+	GLuint m_Queries[QUERY_COUNT];
+	bool m_Pending[QUERY_COUNT] = {};
+	int m_Next = 0;
+	bool m_Timing = false;
+
+	float m_SmoothedMs = 0.0f;
+	int m_Level = 0;
+	int m_Settle = 0;
+	int m_UnderBudget = 0;
+
+	// Size of the level's render, in whole texels and at least one
+	glm::vec2 renderSize() const {
+		return glm::max(glm::floor(LEVELS[m_Level].scale * glm::vec2(m_Width, m_Height)), glm::vec2(1.0f));
+	}
+
+	// Reads every finished query, oldest first, and reacts to each
+	void collect() {
+		for (int i = 0; i < QUERY_COUNT; i++) {
+			int index = (m_Next + i) % QUERY_COUNT;
+			if (!m_Pending[index]) continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(m_Queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(m_Queries[index], GL_QUERY_RESULT, &nanoseconds);
+			m_Pending[index] = false;
+			update(nanoseconds / 1e6f);
+		}
+	}
+
+	void update(float frameMs) {
+		// Without a budget every frame would be over it
+		if (m_BudgetMs <= 0.0f) return;
+
+		m_SmoothedMs = m_SmoothedMs > 0.0f ? m_SmoothedMs + SMOOTHING * (frameMs - m_SmoothedMs) : frameMs;
+		m_UnderBudget = m_SmoothedMs < RAISE_RATIO * m_BudgetMs ? m_UnderBudget + 1 : 0;
+		if (m_Settle > 0) {
+			m_Settle--;
+			return;
+		}
+
+		int level = m_Level;
+		if (m_SmoothedMs > m_BudgetMs && m_Level < LEVEL_COUNT - 1) {
+			level++;
+		}
+		else if (m_UnderBudget >= RAISE_FRAMES && m_Level > 0) {
+			level--;
+		}
+		if (level == m_Level) return;
+
+		m_Level = level;
+		m_Settle = SETTLE_FRAMES;
+		m_UnderBudget = 0;
+		std::cout << "Quality level " << m_Level << " (" << m_SmoothedMs << " ms, budget " << m_BudgetMs << " ms)" << std::endl;
+	}
+};
+
+#endif //QUALITY_GOVERNOR_H
@@ -0,0 +1,32 @@
+#ifndef RAY_STREAM_H
+#define RAY_STREAM_H
+
+// Structure-of-arrays batch of rays. The packet kernels march `count` rays in
+// groups of their lane width and write the hit distance and step count per ray.
+struct SceneOp;
+struct SceneBvhNode;
+
+struct RayStream {
+	const float* ox;
+	const float* oy;
+	const float* oz;
+	const float* dx;
+	const float* dy;
+	const float* dz;
+	float* dist;
+	int* steps;
+	unsigned count;
+	const SceneOp* ops;
+	const SceneBvhNode* nodes;
+	unsigned nodeCount;
+	float pixelRadius;
+};
+
+typedef void (*MarchPacketsFn)(const RayStream& rays);
+
+// Each of these lives in its own translation unit compiled for that instruction set
+void MarchPacketsSSE(const RayStream& rays);
+void MarchPacketsAVX2(const RayStream& rays);
+void MarchPacketsAVX512(const RayStream& rays);
+
+#endif //RAY_STREAM_H
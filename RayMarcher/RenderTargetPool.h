@@ -0,0 +1,178 @@
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// Storage format of the ray marched image, the GLSL image format qualifier
+// goes into compute.glsl as IMAGE_FORMAT
+struct ImageFormat {
+	const char* name;
+	GLenum internalFormat;
+	const char* qualifier;
+	unsigned bytesPerPixel;
+};
+
+inline const ImageFormat* FindImageFormat(const std::string& name)
+{
+	static const ImageFormat formats[] = {
+		{ "rgba32f", GL_RGBA32F, "rgba32f", 16 },
+		{ "rgba16f", GL_RGBA16F, "rgba16f", 8 },
+		{ "rgba8", GL_RGBA8, "rgba8", 4 },
+		{ "r11g11b10f", GL_R11F_G11F_B10F, "r11f_g11f_b10f", 4 },
+	};
+	for (const ImageFormat& format : formats) {
+		if (name == format.name) return &format;
+	}
+	return nullptr;
+}
+
+// Owns the screen sized images the passes render into, each bound to its own
+// image unit. Storage is immutable (glTexStorage2D), so a resize swaps in new
+// textures: resize() only records the size and update() reallocates once it has
+// stopped changing for a few frames, which keeps a window drag from allocating
+// every frame. Replaced textures are kept as spares and picked up again when a
+// later resize asks for the same format and size.
+class RenderTargetPool {
+public:
+	RenderTargetPool(GLuint width, GLuint height) : m_Width(width), m_Height(height), m_PendingWidth(width), m_PendingHeight(height) {}
+
+	~RenderTargetPool() {
+		for (const Target& target : m_Targets) {
+			glDeleteTextures(1, &target.texture);
+		}
+		for (const Target& spare : m_Spares) {
+			glDeleteTextures(1, &spare.texture);
+		}
+	}
+
+	RenderTargetPool(const RenderTargetPool&) = delete;
+	RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+	// For targets that are only copied to and from, never bound as an image
+	static const GLuint NO_IMAGE_UNIT = 0xFFFFFFFF;
+
+	// Adds a target of ceil(width / divisor) x ceil(height / divisor) texels, cleared
+	// to zero and bound to imageUnit; returns its handle
+	int add(GLenum format, GLuint imageUnit, GLuint divisor = 1) {
+		Target target = { format, imageUnit, divisor, 0, 0, 0 };
+		allocate(target);
+		m_Targets.push_back(target);
+		return (int)m_Targets.size() - 1;
+	}
+
+	GLuint texture(int target) const { return m_Targets[target].texture; }
+	GLuint width(int target) const { return m_Targets[target].width; }
+	GLuint height(int target) const { return m_Targets[target].height; }
+
+	// Full size the targets are currently allocated for
+	GLuint width() const { return m_Width; }
+	GLuint height() const { return m_Height; }
+
+	// Fills the target on the GPU; format and type describe data as for glClearTexImage
+	void clear(int target, GLenum format, GLenum type, const void* data) {
+		glClearTexImage(m_Targets[target].texture, 0, format, type, data);
+	}
+
+	// Requests a new full size, applied by update(); zero sizes (minimized windows) are ignored
+	void resize(GLuint width, GLuint height) {
+		if (width == 0 || height == 0) return;
+		if (width != m_PendingWidth || height != m_PendingHeight) {
+			m_PendingWidth = width;
+			m_PendingHeight = height;
+			m_Stable = 0;
+		}
+	}
+
+	// Call once per frame before rendering. Returns true if the targets were
+	// reallocated at a new size, after which their contents are undefined
+	bool update() {
+		if (m_PendingWidth == m_Width && m_PendingHeight == m_Height) return false;
+		if (++m_Stable < SETTLE_FRAMES) return false;
+
+		m_Width = m_PendingWidth;
+		m_Height = m_PendingHeight;
+		for (Target& target : m_Targets) {
+			release(target);
+			allocate(target);
+		}
+		return true;
+	}
+
+private:
+	struct Target {
+		GLenum format;
+		GLuint unit;
+		GLuint divisor;
+		GLuint texture;
+		GLuint width;
+		GLuint height;
+	};
+
+	static const int SETTLE_FRAMES = 5;
+	static const size_t MAX_SPARES = 8;
+
+	std::vector<Target> m_Targets;
+	std::vector<Target> m_Spares;
+	GLuint m_Width;
+	GLuint m_Height;
+	GLuint m_PendingWidth;
+	GLuint m_PendingHeight;
+	int m_Stable = 0;
+
+	void allocate(Target& target) {
+		target.width = (m_Width + target.divisor - 1) / target.divisor;
+		target.height = (m_Height + target.divisor - 1) / target.divisor;
+		target.texture = 0;
+
+		for (size_t i = 0; i < m_Spares.size(); i++) {
+			const Target& spare = m_Spares[i];
+			if (spare.format == target.format && spare.width == target.width && spare.height == target.height) {
+				target.texture = spare.texture;
+				m_Spares.erase(m_Spares.begin() + i);
+				break;
+			}
+		}
+
+		if (!target.texture) {
+			glGenTextures(1, &target.texture);
+			glBindTexture(GL_TEXTURE_2D, target.texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexStorage2D(GL_TEXTURE_2D, 1, target.format, target.width, target.height);
+		}
+
+		// A null clear value is zero in any format
+		glClearTexImage(target.texture, 0, clearFormat(target.format), GL_UNSIGNED_INT, NULL);
+		if (target.unit != NO_IMAGE_UNIT) {
+			glBindImageTexture(target.unit, target.texture, 0, GL_FALSE, 0, GL_READ_WRITE, target.format);
+		}
+	}
+
+	void release(Target& target) {
+		m_Spares.push_back(target);
+		if (m_Spares.size() > MAX_SPARES) {
+			glDeleteTextures(1, &m_Spares.front().texture);
+			m_Spares.erase(m_Spares.begin());
+		}
+	}
+
+	static GLenum clearFormat(GLenum format) {
+		switch (format) {
+		case GL_R32UI:
+		case GL_R32I:
+			return GL_RED_INTEGER;
+		case GL_RGBA32UI:
+		case GL_RGBA32I:
+			return GL_RGBA_INTEGER;
+		default:
+			return GL_RGBA;
+		}
+	}
+};
+
+#endif //RENDER_TARGET_POOL_H
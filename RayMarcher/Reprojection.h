@@ -0,0 +1,94 @@
+#ifndef REPROJECTION_H
+#define REPROJECTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ComputeShader.h"
+#include "FrameParams.h"
+#include "RenderTargetPool.h"
+
+// Temporal warm start of the ray march. compute.glsl stores every pixel's hit
+// distance in an R32F depth image; at the start of the next frame
+// reproject.glsl moves those hits into the new view, keeping the nearest per
+// pixel in an R32UI image, and rays start from a fraction of that distance.
+// The history has to be invalidated whenever the depth image stops describing
+// the previous frame, e.g. after a scene change or a CPU rendered frame.
+class Reprojection {
+public:
+	Reprojection(const char* path, RenderTargetPool& targets, GLuint depthUnit, GLuint reprojectedUnit) : m_Shader(path), m_Targets(targets) {
+		m_Depth = targets.add(GL_R32F, depthUnit);
+		m_Reprojected = targets.add(GL_R32UI, reprojectedUnit);
+	}
+
+	~Reprojection() {
+		glDeleteProgram(m_Shader.m_ID);
+	}
+
+	Reprojection(const Reprojection&) = delete;
+	Reprojection& operator=(const Reprojection&) = delete;
+
+	void invalidate() {
+		m_HasHistory = false;
+	}
+
+	// Fills the reprojection fields of params for a frame rendered with
+	// params.cameraToWorld and remembers that camera for the next frame
+	void beginFrame(FrameParams& params, bool enabled) {
+		params.useReprojection = enabled && m_HasHistory ? 1 : 0;
+		params.prevCameraToWorld = m_PrevCameraToWorld;
+		params.worldToClip = glm::inverse(params.invProjection) * glm::inverse(params.cameraToWorld);
+
+		m_PrevCameraToWorld = params.cameraToWorld;
+		m_HasHistory = true;
+	}
+
+	// Keeps the depth history out of a render that isn't part of the frame
+	// sequence, e.g. the benchmark's plain comparison, which still has to write
+	// depth for its shading pass: save before it and restore after. The copy is
+	// allocated on first use.
+	void saveHistory() {
+		if (m_Backup < 0) {
+			m_Backup = m_Targets.add(GL_R32F, RenderTargetPool::NO_IMAGE_UNIT);
+		}
+		copy(m_Depth, m_Backup);
+	}
+
+	void restoreHistory() {
+		if (m_Backup >= 0) {
+			copy(m_Backup, m_Depth);
+		}
+	}
+
+	// Scatters the previous depth into the current view with the frame parameters
+	// already bound; the ray march dispatched next reads the result
+	void dispatch(const FrameParams& params) {
+		if (!params.useReprojection) return;
+
+		const GLuint empty = 0xFFFFFFFF;
+		m_Targets.clear(m_Reprojected, GL_RED_INTEGER, GL_UNSIGNED_INT, &empty);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		m_Shader.use();
+		m_Shader.dispatchPixels(m_Targets.width(m_Depth), m_Targets.height(m_Depth));
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+private:
+	ComputeShader m_Shader;
+	RenderTargetPool& m_Targets;
+	int m_Depth;
+	int m_Reprojected;
+	int m_Backup = -1;
+
+	bool m_HasHistory = false;
+	glm::mat4 m_PrevCameraToWorld = glm::mat4(1.0f);
+
+	void copy(int from, int to) {
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glCopyImageSubData(m_Targets.texture(from), GL_TEXTURE_2D, 0, 0, 0, 0, m_Targets.texture(to), GL_TEXTURE_2D, 0, 0, 0, 0,
+			m_Targets.width(from), m_Targets.height(from), 1);
+	}
+};
+
+#endif //REPROJECTION_H
@@ -0,0 +1,534 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+#include "SceneTypes.h"
+
+struct SceneNode {
+	SceneOpType type;
+	glm::vec3 position = glm::vec3(0.0f);
+	float radius = 0.0f;
+	glm::vec3 size = glm::vec3(0.0f);
+	int left = -1;
+	int right = -1;
+};
+
+// Scene loaded from a text file with one statement per line, in postfix order:
+//
+//   sphere <x> <y> <z> <radius>
+//   box <x> <y> <z> <half x> <half y> <half z>
+//   union | intersect | difference
+//
+// Whatever is left on the stack at the end is unioned together, so a plain list
+// of primitives is a valid scene.
+//
+// Besides the flat program, the scene keeps a BVH over the operands of its
+// top-level union ("items"). sceneSDF only evaluates items whose bounds are
+// closer than the best distance found so far, and answers with the bound
+// distance for nodes that are far away relative to their size, so the cost of
+// a sample grows with the log of the scene size rather than linearly.
+class Scene {
+public:
+	bool load(const std::string& path) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cout << "Failed to open scene " << path << std::endl;
+			return false;
+		}
+		return parse(file, path);
+	}
+
+	bool parse(std::istream& input, const std::string& name = "scene") {
+		std::vector<SceneNode> nodes;
+		std::vector<int> stack;
+
+		std::string line;
+		for (int lineNumber = 1; std::getline(input, line); lineNumber++) {
+			std::istringstream stream(line);
+			std::string keyword;
+			if (!(stream >> keyword) || keyword[0] == '#') continue;
+
+			SceneNode node;
+			bool ok = true;
+			if (keyword == "sphere") {
+				node.type = OP_SPHERE;
+				ok = (bool)(stream >> node.position.x >> node.position.y >> node.position.z >> node.radius);
+			}
+			else if (keyword == "box") {
+				node.type = OP_BOX;
+				ok = (bool)(stream >> node.position.x >> node.position.y >> node.position.z >> node.size.x >> node.size.y >> node.size.z);
+			}
+			else if (keyword == "union" || keyword == "intersect" || keyword == "difference") {
+				node.type = keyword == "union" ? OP_UNION : keyword == "intersect" ? OP_INTERSECT : OP_DIFFERENCE;
+				if (stack.size() < 2) {
+					std::cout << name << ":" << lineNumber << ": " << keyword << " needs two operands" << std::endl;
+					return false;
+				}
+				node.right = stack.back();
+				stack.pop_back();
+				node.left = stack.back();
+				stack.pop_back();
+			}
+			else {
+				ok = false;
+			}
+
+			if (!ok) {
+				std::cout << name << ":" << lineNumber << ": cannot parse \"" << line << "\"" << std::endl;
+				return false;
+			}
+
+			stack.push_back((int)nodes.size());
+			nodes.push_back(node);
+		}
+
+		if (stack.empty()) {
+			std::cout << name << ": scene is empty" << std::endl;
+			return false;
+		}
+
+		for (size_t i = 1; i < stack.size(); i++) {
+			SceneNode node;
+			node.type = OP_UNION;
+			node.left = i == 1 ? stack[0] : (int)nodes.size() - 1;
+			node.right = stack[i];
+			nodes.push_back(node);
+		}
+
+		m_Nodes = nodes;
+		m_Root = (int)m_Nodes.size() - 1;
+		computeDepths();
+		m_Ops.clear();
+		emit(m_Root, m_Ops);
+
+		int depth = m_Depths[m_Root];
+		if (depth > SCENE_STACK_SIZE) {
+			std::cout << name << ": scene needs a stack of " << depth << ", only " << SCENE_STACK_SIZE << " is supported" << std::endl;
+			return false;
+		}
+		return buildBvh(name);
+	}
+
+	const std::vector<SceneNode>& nodes() const { return m_Nodes; }
+	int root() const { return m_Root; }
+
+	// Postfix program in the layout uploaded to the GPU
+	const std::vector<SceneOp>& ops() const { return m_Ops; }
+
+	// Leaf programs and nodes of the BVH, in the layout uploaded to the GPU
+	const std::vector<SceneOp>& bvhOps() const { return m_BvhOps; }
+	const std::vector<SceneBvhNode>& bvhNodes() const { return m_BvhNodes; }
+
+	// Identifies the scene program, e.g. for caching shader variants compiled from it
+	uint64_t hash() const {
+		return HashBytes(m_Ops.data(), m_Ops.size() * sizeof(SceneOp));
+	}
+
+	static float sphereSDF(glm::vec3 p, glm::vec3 pos, float radius) {
+		p = p - pos;
+		return glm::length(p) - radius;
+	}
+
+	static float boxSDF(glm::vec3 p, glm::vec3 pos, glm::vec3 size) {
+		p = p - pos;
+		glm::vec3 q = glm::abs(p) - size;
+		return glm::length(glm::max(q, 0.0f)) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
+	}
+
+	// Distance and gradient as a dual number, gradient in xyz and distance in w
+	static glm::vec4 sphereGradient(glm::vec3 p, glm::vec3 pos, float radius) {
+		p = p - pos;
+		float length = glm::length(p);
+		return glm::vec4(length > 0.0f ? p / length : glm::vec3(0.0f), length - radius);
+	}
+
+	// Outside the gradient points away from the closest point of the box, inside
+	// away from the closest face
+	static glm::vec4 boxGradient(glm::vec3 p, glm::vec3 pos, glm::vec3 size) {
+		p = p - pos;
+		glm::vec3 side(p.x < 0.0f ? -1.0f : 1.0f, p.y < 0.0f ? -1.0f : 1.0f, p.z < 0.0f ? -1.0f : 1.0f);
+		glm::vec3 q = glm::abs(p) - size;
+		glm::vec3 outside = glm::max(q, 0.0f);
+		float length = glm::length(outside);
+		if (length > 0.0f) {
+			return glm::vec4(side * outside / length, length);
+		}
+
+		int axis = q.x > q.y ? (q.x > q.z ? 0 : 2) : (q.y > q.z ? 1 : 2);
+		glm::vec3 gradient(0.0f);
+		gradient[axis] = side[axis];
+		return glm::vec4(gradient, q[axis]);
+	}
+
+	// min, max and max(a, -b) of dual numbers pick the operand that decides the distance
+	static glm::vec4 unionGradient(glm::vec4 a, glm::vec4 b) {
+		return a.w <= b.w ? a : b;
+	}
+
+	static glm::vec4 intersectGradient(glm::vec4 a, glm::vec4 b) {
+		return a.w >= b.w ? a : b;
+	}
+
+	static glm::vec4 differenceGradient(glm::vec4 a, glm::vec4 b) {
+		return a.w >= -b.w ? a : -b;
+	}
+
+	// Same walk as sceneSDF in scene.glsl
+	static float evaluate(const SceneOp* ops, size_t count, glm::vec3 p) {
+		float stack[SCENE_STACK_SIZE];
+		int top = 0;
+		for (size_t i = 0; i < count; i++) {
+			const SceneOp& op = ops[i];
+			switch (op.type) {
+			case OP_SPHERE:
+				stack[top++] = sphereSDF(p, glm::vec3(op.params), op.params.w);
+				break;
+			case OP_BOX:
+				stack[top++] = boxSDF(p, glm::vec3(op.params), op.size);
+				break;
+			case OP_UNION:
+				top--;
+				stack[top - 1] = glm::min(stack[top - 1], stack[top]);
+				break;
+			case OP_INTERSECT:
+				top--;
+				stack[top - 1] = glm::max(stack[top - 1], stack[top]);
+				break;
+			case OP_DIFFERENCE:
+				top--;
+				stack[top - 1] = glm::max(stack[top - 1], -stack[top]);
+				break;
+			}
+		}
+		return top > 0 ? stack[0] : 1000000.0f;
+	}
+
+	// evaluate() on dual numbers, see sceneGradient in scene.glsl
+	static glm::vec4 gradient(const SceneOp* ops, size_t count, glm::vec3 p) {
+		glm::vec4 stack[SCENE_STACK_SIZE];
+		int top = 0;
+		for (size_t i = 0; i < count; i++) {
+			const SceneOp& op = ops[i];
+			switch (op.type) {
+			case OP_SPHERE:
+				stack[top++] = sphereGradient(p, glm::vec3(op.params), op.params.w);
+				break;
+			case OP_BOX:
+				stack[top++] = boxGradient(p, glm::vec3(op.params), op.size);
+				break;
+			case OP_UNION:
+				top--;
+				stack[top - 1] = unionGradient(stack[top - 1], stack[top]);
+				break;
+			case OP_INTERSECT:
+				top--;
+				stack[top - 1] = intersectGradient(stack[top - 1], stack[top]);
+				break;
+			case OP_DIFFERENCE:
+				top--;
+				stack[top - 1] = differenceGradient(stack[top - 1], stack[top]);
+				break;
+			}
+		}
+		return top > 0 ? stack[0] : glm::vec4(0.0f, 0.0f, 0.0f, 1000000.0f);
+	}
+
+	// Lower bound of the distance from p to anything inside the node, 0 inside
+	static float boundsDistance(glm::vec3 p, const SceneBvhNode& node) {
+		return glm::length(glm::max(glm::max(node.min - p, p - node.max), 0.0f));
+	}
+
+	// Same traversal as sceneSDF in scene.glsl. Nodes further away than the best
+	// distance so far are skipped, and nodes further away than their own diagonal
+	// contribute their bound distance instead of being opened; both keep the
+	// result a lower bound of the true distance, which is all marching needs.
+	static float evaluate(const SceneBvhNode* nodes, size_t nodeCount, const SceneOp* ops, glm::vec3 p) {
+		float best = 1000000.0f;
+		if (nodeCount == 0) return best;
+
+		uint32_t stack[SCENE_BVH_STACK_SIZE];
+		float stackDist[SCENE_BVH_STACK_SIZE];
+		int top = 0;
+		stack[top] = 0;
+		stackDist[top++] = boundsDistance(p, nodes[0]);
+
+		while (top > 0) {
+			top--;
+			const SceneBvhNode& node = nodes[stack[top]];
+			float dist = stackDist[top];
+			if (dist >= best) continue;
+
+			if (dist > glm::length(node.max - node.min)) {
+				best = dist;
+			}
+			else if (node.count > 0) {
+				best = glm::min(best, evaluate(ops + node.first, node.count, p));
+			}
+			else {
+				// Push the far child first so the near one is visited next and tightens best sooner
+				float left = boundsDistance(p, nodes[node.first]);
+				float right = boundsDistance(p, nodes[node.first + 1]);
+				bool leftFirst = left <= right;
+				stack[top] = leftFirst ? node.first + 1 : node.first;
+				stackDist[top++] = leftFirst ? right : left;
+				stack[top] = leftFirst ? node.first : node.first + 1;
+				stackDist[top++] = leftFirst ? left : right;
+			}
+		}
+		return best;
+	}
+
+	// The BVH traversal on dual numbers. Nodes answering with their bound distance
+	// have no gradient; they never win close to a surface, where normals are taken.
+	static glm::vec4 gradient(const SceneBvhNode* nodes, size_t nodeCount, const SceneOp* ops, glm::vec3 p) {
+		glm::vec4 best(0.0f, 0.0f, 0.0f, 1000000.0f);
+		if (nodeCount == 0) return best;
+
+		uint32_t stack[SCENE_BVH_STACK_SIZE];
+		float stackDist[SCENE_BVH_STACK_SIZE];
+		int top = 0;
+		stack[top] = 0;
+		stackDist[top++] = boundsDistance(p, nodes[0]);
+
+		while (top > 0) {
+			top--;
+			const SceneBvhNode& node = nodes[stack[top]];
+			float dist = stackDist[top];
+			if (dist >= best.w) continue;
+
+			if (dist > glm::length(node.max - node.min)) {
+				best = glm::vec4(0.0f, 0.0f, 0.0f, dist);
+			}
+			else if (node.count > 0) {
+				best = unionGradient(best, gradient(ops + node.first, node.count, p));
+			}
+			else {
+				float left = boundsDistance(p, nodes[node.first]);
+				float right = boundsDistance(p, nodes[node.first + 1]);
+				bool leftFirst = left <= right;
+				stack[top] = leftFirst ? node.first + 1 : node.first;
+				stackDist[top++] = leftFirst ? right : left;
+				stack[top] = leftFirst ? node.first : node.first + 1;
+				stackDist[top++] = leftFirst ? left : right;
+			}
+		}
+		return best;
+	}
+
+	float evaluate(glm::vec3 p) const {
+		return evaluate(m_BvhNodes.data(), m_BvhNodes.size(), m_BvhOps.data(), p);
+	}
+
+private:
+	std::vector<SceneNode> m_Nodes;
+	int m_Root = -1;
+	std::vector<SceneOp> m_Ops;
+	std::vector<int> m_Depths;
+	std::vector<SceneOp> m_BvhOps;
+	std::vector<SceneBvhNode> m_BvhNodes;
+
+	static const unsigned BVH_LEAF_SIZE = 4;
+
+	struct Item {
+		int node;
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	// Operators swap their operands when that keeps the stack shallower. Only
+	// union and intersect may, difference has to evaluate its left side first.
+	bool rightFirst(const SceneNode& node) const {
+		return isCommutative(node.type) && m_Depths[node.right] > m_Depths[node.left];
+	}
+
+	// Stack slots each subtree needs. Children always come before their parent
+	// in m_Nodes, so one forward pass is enough.
+	void computeDepths() {
+		m_Depths.assign(m_Nodes.size(), 1);
+		for (size_t i = 0; i < m_Nodes.size(); i++) {
+			const SceneNode& node = m_Nodes[i];
+			if (node.left < 0) continue;
+
+			int first = m_Depths[rightFirst(node) ? node.right : node.left];
+			int second = m_Depths[rightFirst(node) ? node.left : node.right];
+			m_Depths[i] = std::max(first, second + 1);
+		}
+	}
+
+	// Emits the subtree in postfix order, deeper operand first, so long union
+	// chains only need two stack slots. Iterative because generated scenes can
+	// nest thousands of operators.
+	void emit(int root, std::vector<SceneOp>& ops) const {
+		std::vector<std::pair<int, bool>> pending = { { root, false } };
+		while (!pending.empty()) {
+			std::pair<int, bool> entry = pending.back();
+			pending.pop_back();
+
+			const SceneNode& node = m_Nodes[entry.first];
+			if (node.left >= 0 && !entry.second) {
+				bool swap = rightFirst(node);
+				pending.push_back({ entry.first, true });
+				pending.push_back({ swap ? node.left : node.right, false });
+				pending.push_back({ swap ? node.right : node.left, false });
+				continue;
+			}
+
+			SceneOp op;
+			op.params = glm::vec4(node.position, node.radius);
+			op.size = node.size;
+			op.type = node.type;
+			ops.push_back(op);
+		}
+	}
+
+	static bool isCommutative(SceneOpType type) {
+		return type == OP_UNION || type == OP_INTERSECT;
+	}
+
+	// Axis aligned bounds of every node, children before parents like computeDepths
+	void computeBounds(std::vector<glm::vec3>& lo, std::vector<glm::vec3>& hi) const {
+		lo.resize(m_Nodes.size());
+		hi.resize(m_Nodes.size());
+		for (size_t i = 0; i < m_Nodes.size(); i++) {
+			const SceneNode& node = m_Nodes[i];
+			switch (node.type) {
+			case OP_SPHERE:
+				lo[i] = node.position - node.radius;
+				hi[i] = node.position + node.radius;
+				break;
+			case OP_BOX:
+				lo[i] = node.position - node.size;
+				hi[i] = node.position + node.size;
+				break;
+			case OP_UNION:
+				lo[i] = glm::min(lo[node.left], lo[node.right]);
+				hi[i] = glm::max(hi[node.left], hi[node.right]);
+				break;
+			case OP_INTERSECT:
+				lo[i] = glm::max(lo[node.left], lo[node.right]);
+				hi[i] = glm::min(hi[node.left], hi[node.right]);
+				// Disjoint operands leave nothing to hit; any bounds will do
+				if (lo[i].x > hi[i].x || lo[i].y > hi[i].y || lo[i].z > hi[i].z) {
+					lo[i] = lo[node.left];
+					hi[i] = hi[node.left];
+				}
+				break;
+			case OP_DIFFERENCE:
+				lo[i] = lo[node.left];
+				hi[i] = hi[node.left];
+				break;
+			}
+		}
+	}
+
+	bool buildBvh(const std::string& name) {
+		std::vector<glm::vec3> lo, hi;
+		computeBounds(lo, hi);
+
+		// Split the top-level union into items
+		std::vector<Item> items;
+		std::vector<int> pending = { m_Root };
+		while (!pending.empty()) {
+			int index = pending.back();
+			pending.pop_back();
+			const SceneNode& node = m_Nodes[index];
+			if (node.type == OP_UNION) {
+				pending.push_back(node.right);
+				pending.push_back(node.left);
+			}
+			else {
+				items.push_back({ index, lo[index], hi[index] });
+			}
+		}
+
+		m_BvhNodes.clear();
+		m_BvhOps.clear();
+		m_BvhNodes.push_back(SceneBvhNode());
+		int depth = buildBvhNode(0, items, 0, items.size());
+		if (depth > SCENE_BVH_STACK_SIZE) {
+			std::cout << name << ": BVH depth " << depth << " exceeds " << SCENE_BVH_STACK_SIZE << std::endl;
+			return false;
+		}
+
+		// Each leaf program unions its items one by one, deepest first, so it
+		// needs one slot more than its other items
+		for (const SceneBvhNode& node : m_BvhNodes) {
+			if (node.count == 0) continue;
+
+			int leafDepth = 0, ops = 0;
+			for (size_t i = node.first; i < node.first + node.count; i++) {
+				const SceneOp& op = m_BvhOps[i];
+				ops += op.type <= OP_BOX ? 1 : -1;
+				leafDepth = std::max(leafDepth, ops);
+			}
+			if (leafDepth > SCENE_STACK_SIZE) {
+				std::cout << name << ": BVH leaf needs a stack of " << leafDepth << ", only " << SCENE_STACK_SIZE << " is supported" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Median split on the longest centroid axis; fills m_BvhNodes[index] and returns the subtree depth
+	int buildBvhNode(size_t index, std::vector<Item>& items, size_t begin, size_t end) {
+		SceneBvhNode node;
+		node.min = glm::vec3(1e30f);
+		node.max = glm::vec3(-1e30f);
+		glm::vec3 centerMin(1e30f), centerMax(-1e30f);
+		for (size_t i = begin; i < end; i++) {
+			node.min = glm::min(node.min, items[i].min);
+			node.max = glm::max(node.max, items[i].max);
+			glm::vec3 center = 0.5f * (items[i].min + items[i].max);
+			centerMin = glm::min(centerMin, center);
+			centerMax = glm::max(centerMax, center);
+		}
+
+		if (end - begin <= BVH_LEAF_SIZE) {
+			std::sort(items.begin() + begin, items.begin() + end, [&](const Item& a, const Item& b) {
+				return m_Depths[a.node] > m_Depths[b.node];
+			});
+
+			node.first = (uint32_t)m_BvhOps.size();
+			for (size_t i = begin; i < end; i++) {
+				emit(items[i].node, m_BvhOps);
+				if (i > begin) {
+					SceneOp op = {};
+					op.type = OP_UNION;
+					m_BvhOps.push_back(op);
+				}
+			}
+			node.count = (uint32_t)(m_BvhOps.size() - node.first);
+			m_BvhNodes[index] = node;
+			return 1;
+		}
+
+		glm::vec3 extent = centerMax - centerMin;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		size_t middle = begin + (end - begin) / 2;
+		std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [axis](const Item& a, const Item& b) {
+			return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+		});
+
+		node.first = (uint32_t)m_BvhNodes.size();
+		node.count = 0;
+		m_BvhNodes[index] = node;
+		m_BvhNodes.push_back(SceneBvhNode());
+		m_BvhNodes.push_back(SceneBvhNode());
+
+		int left = buildBvhNode(node.first, items, begin, middle);
+		int right = buildBvhNode(node.first + 1, items, middle, end);
+		return 1 + std::max(left, right);
+	}
+};
+
+#endif //SCENE_H
@@ -0,0 +1,56 @@
+#ifndef SCENE_BUFFER_H
+#define SCENE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "Scene.h"
+
+// Shader storage buffers holding the scene read by sceneSDF in scene.glsl:
+// the BVH leaf programs at opBinding and the BVH nodes at bvhBinding, each a
+// 16 byte header with the element count followed by the elements. Uploading a
+// new scene reuses the storage unless it has to grow.
+class SceneBuffer {
+public:
+	SceneBuffer(GLuint opBinding, GLuint bvhBinding) : m_Bindings{ opBinding, bvhBinding } {
+		glGenBuffers(2, m_Buffers);
+	}
+
+	~SceneBuffer() {
+		glDeleteBuffers(2, m_Buffers);
+	}
+
+	SceneBuffer(const SceneBuffer&) = delete;
+	SceneBuffer& operator=(const SceneBuffer&) = delete;
+
+	void upload(const Scene& scene) {
+		upload(0, scene.bvhOps().data(), scene.bvhOps().size(), sizeof(SceneOp));
+		upload(1, scene.bvhNodes().data(), scene.bvhNodes().size(), sizeof(SceneBvhNode));
+	}
+
+private:
+	static const GLsizeiptr HEADER_SIZE = 16;
+
+	GLuint m_Bindings[2];
+	GLuint m_Buffers[2] = { 0, 0 };
+	GLsizeiptr m_Capacity[2] = { 0, 0 };
+
+	void upload(int index, const void* data, size_t count, size_t stride) {
+		GLsizeiptr size = HEADER_SIZE + count * stride;
+		GLuint header[HEADER_SIZE / sizeof(GLuint)] = { (GLuint)count };
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffers[index]);
+		if (size > m_Capacity[index]) {
+			glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+			m_Capacity[index] = size;
+		}
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, HEADER_SIZE, header);
+		if (count > 0) {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, HEADER_SIZE, count * stride, data);
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_Bindings[index], m_Buffers[index]);
+	}
+};
+
+#endif //SCENE_BUFFER_H
@@ -0,0 +1,134 @@
+#ifndef SCENE_COMPILER_H
+#define SCENE_COMPILER_H
+
+#include <glm/glm.hpp>
+
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+
+// Turns a scene program into a straight-line GLSL sceneSDF for scene.glsl, and a
+// sceneGradient evaluating the same program on dual numbers for normals. Every
+// primitive and operator becomes one statement with its parameters as literals,
+// so the compiled variant has no scene buffer reads, no op switch and no stack;
+// translations by zero are dropped.
+class SceneCompiler {
+public:
+	// Above this many ops the generated function gets slow to compile and the
+	// data path is used instead
+	static const size_t MAX_OPS = 1024;
+
+	static bool compilable(const std::vector<SceneOp>& ops) {
+		return !ops.empty() && ops.size() <= MAX_OPS;
+	}
+
+	static std::string compile(const std::vector<SceneOp>& ops) {
+		std::ostringstream code;
+		code.imbue(std::locale::classic());
+		code << "float sceneSDF(vec3 p)\n{\n";
+
+		std::vector<std::string> stack;
+		for (size_t i = 0; i < ops.size(); i++) {
+			const SceneOp& op = ops[i];
+			std::string name = "d" + std::to_string(i);
+			std::string q = "q" + std::to_string(i);
+
+			switch (op.type) {
+			case OP_SPHERE:
+				code << "\tfloat " << name << " = length(" << offset(glm::vec3(op.params)) << ") - " << literal(op.params.w) << ";\n";
+				stack.push_back(name);
+				continue;
+			case OP_BOX:
+				code << "\tvec3 " << q << " = abs(" << offset(glm::vec3(op.params)) << ") - " << literal(op.size) << ";\n";
+				code << "\tfloat " << name << " = length(max(" << q << ", 0.0)) + min(max(" << q << ".x, max(" << q << ".y, " << q << ".z)), 0.0);\n";
+				stack.push_back(name);
+				continue;
+			}
+
+			std::string right = stack.back();
+			stack.pop_back();
+			std::string left = stack.back();
+			stack.pop_back();
+
+			switch (op.type) {
+			case OP_UNION:
+				code << "\tfloat " << name << " = min(" << left << ", " << right << ");\n";
+				break;
+			case OP_INTERSECT:
+				code << "\tfloat " << name << " = max(" << left << ", " << right << ");\n";
+				break;
+			case OP_DIFFERENCE:
+				code << "\tfloat " << name << " = max(" << left << ", -" << right << ");\n";
+				break;
+			}
+			stack.push_back(name);
+		}
+
+		code << "\treturn " << (stack.empty() ? "MAX_DIST" : stack.back()) << ";\n}\n";
+		compileGradient(ops, code);
+		return code.str();
+	}
+
+private:
+	static void compileGradient(const std::vector<SceneOp>& ops, std::ostringstream& code) {
+		code << "\n#define SCENE_GRADIENT\nvec4 sceneGradient(vec3 p)\n{\n";
+
+		std::vector<std::string> stack;
+		for (size_t i = 0; i < ops.size(); i++) {
+			const SceneOp& op = ops[i];
+			std::string name = "g" + std::to_string(i);
+
+			switch (op.type) {
+			case OP_SPHERE:
+				code << "\tvec4 " << name << " = sphereGradient(p, " << literal(glm::vec3(op.params)) << ", " << literal(op.params.w) << ");\n";
+				stack.push_back(name);
+				continue;
+			case OP_BOX:
+				code << "\tvec4 " << name << " = boxGradient(p, " << literal(glm::vec3(op.params)) << ", " << literal(op.size) << ");\n";
+				stack.push_back(name);
+				continue;
+			}
+
+			std::string right = stack.back();
+			stack.pop_back();
+			std::string left = stack.back();
+			stack.pop_back();
+
+			const char* combine = op.type == OP_UNION ? "unionGradient" : op.type == OP_INTERSECT ? "intersectGradient" : "differenceGradient";
+			code << "\tvec4 " << name << " = " << combine << "(" << left << ", " << right << ");\n";
+			stack.push_back(name);
+		}
+
+		code << "\treturn " << (stack.empty() ? "vec4(0, 0, 0, MAX_DIST)" : stack.back()) << ";\n}\n";
+	}
+
+	// Enough digits to read back as the same float, always with a decimal point
+	static std::string literal(float value) {
+		std::ostringstream stream;
+		stream.imbue(std::locale::classic());
+		stream << std::setprecision(9) << value;
+
+		std::string text = stream.str();
+		if (text.find_first_of(".e") == std::string::npos) {
+			text += ".0";
+		}
+		return text;
+	}
+
+	static std::string literal(glm::vec3 value) {
+		if (value.x == value.y && value.y == value.z) {
+			return "vec3(" + literal(value.x) + ")";
+		}
+		return "vec3(" + literal(value.x) + ", " + literal(value.y) + ", " + literal(value.z) + ")";
+	}
+
+	static std::string offset(glm::vec3 position) {
+		return position == glm::vec3(0.0f) ? "p" : "p - " + literal(position);
+	}
+};
+
+#endif //SCENE_COMPILER_H
@@ -0,0 +1,49 @@
+#ifndef SCENE_TYPES_H
+#define SCENE_TYPES_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// The plain data of a scene, apart from Scene.h so that the SIMD kernels can use
+// it without pulling in any inline code; see SimdKernels.h.
+
+enum SceneOpType {
+	OP_SPHERE,
+	OP_BOX,
+	OP_UNION,
+	OP_INTERSECT,
+	OP_DIFFERENCE
+};
+
+// One entry of the postfix scene program shared by scene.glsl and the CPU
+// backend. Primitives push a distance, operators pop two and push the result.
+// The layout matches the std430 SceneOp struct in scene.glsl.
+struct SceneOp {
+	glm::vec4 params;	// xyz position, w sphere radius
+	glm::vec3 size;		// box half extents
+	uint32_t type;
+};
+
+static_assert(sizeof(SceneOp) == 32, "SceneOp must match the std430 layout in scene.glsl");
+
+// Deepest operand stack a scene program may need; scene.glsl sizes its stack with this
+const int SCENE_STACK_SIZE = 16;
+
+// Node of the bounding volume hierarchy over the top-level union of a scene,
+// matching the std430 SceneBvhNode struct in scene.glsl. Interior nodes have
+// count 0 and their children at first and first + 1; leaves own the postfix
+// program ops[first, first + count), which evaluates to the union of their items.
+struct SceneBvhNode {
+	glm::vec3 min;
+	uint32_t first;
+	glm::vec3 max;
+	uint32_t count;
+};
+
+static_assert(sizeof(SceneBvhNode) == 32, "SceneBvhNode must match the std430 layout in scene.glsl");
+
+// Deepest BVH the traversal stack in scene.glsl can handle
+const int SCENE_BVH_STACK_SIZE = 32;
+
+#endif //SCENE_TYPES_H
@@ -0,0 +1,63 @@
+#ifndef SCENE_VARIANTS_H
+#define SCENE_VARIANTS_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "ComputeShader.h"
+#include "Scene.h"
+#include "SceneCompiler.h"
+
+// The ray march program in two flavours: one generic variant that walks the scene
+// buffer, and one specialized variant per static scene with sceneSDF compiled in.
+// Variants stay linked for the lifetime of the cache, keyed by scene hash, so
+// switching back to a scene seen before costs nothing; across runs the program
+// binary cache avoids the compile.
+class SceneVariants {
+public:
+	SceneVariants(const char* path, const std::string& defines) : m_Path(path), m_Defines(defines) {}
+
+	~SceneVariants() {
+		for (auto& entry : m_Variants) {
+			glDeleteProgram(entry.second.m_ID);
+		}
+	}
+
+	SceneVariants(const SceneVariants&) = delete;
+	SceneVariants& operator=(const SceneVariants&) = delete;
+
+	// Returns the specialized program for scene, or the data path program if
+	// compiled is false or the scene is too large to specialize
+	ComputeShader& get(const Scene& scene, bool compiled) {
+		bool specialize = compiled && SceneCompiler::compilable(scene.ops());
+		uint64_t key = specialize ? scene.hash() : DATA_PATH;
+
+		auto it = m_Variants.find(key);
+		if (it != m_Variants.end()) {
+			return it->second;
+		}
+
+		if (!specialize) {
+			return m_Variants[key] = ComputeShader(m_Path.c_str(), m_Defines);
+		}
+
+		std::cout << "Compiling scene variant " << std::hex << key << std::dec << " (" << scene.ops().size() << " ops)" << std::endl;
+		return m_Variants[key] = ComputeShader(m_Path.c_str(), m_Defines + ShaderDefine("SCENE_COMPILED", 1),
+			{ { "SCENE_SDF", SceneCompiler::compile(scene.ops()) } });
+	}
+
+	size_t size() const { return m_Variants.size(); }
+
+private:
+	// Key of the data path variant; a scene hashing to 0 is vanishingly unlikely
+	static const uint64_t DATA_PATH = 0;
+
+	std::string m_Path;
+	std::string m_Defines;
+	std::unordered_map<uint64_t, ComputeShader> m_Variants;
+};
+
+#endif //SCENE_VARIANTS_H
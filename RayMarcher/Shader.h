@@ -5,9 +5,13 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <fstream>
 #include <iostream>
 
+#include "ProgramCache.h"
+
 class Shader {
 public:
 	unsigned int m_ID = NULL;
@@ -38,6 +42,14 @@ public:
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
 
+		m_ID = glCreateProgram();
+
+		uint64_t cacheKey = ProgramCache::key({ "VERTEX", vertexCode, "FRAGMENT", fragmentCode });
+		if (ProgramCache::load(m_ID, cacheKey)) {
+			cacheUniforms();
+			return;
+		}
+
 		unsigned int vertex, fragment;
 
 		vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -52,63 +64,100 @@ public:
 
 		checkCompileErrors(fragment, "FRAGMENT");
 
-		m_ID = glCreateProgram();
 		glAttachShader(m_ID, vertex);
 		glAttachShader(m_ID, fragment);
+		ProgramCache::prepare(m_ID);
 		glLinkProgram(m_ID);
 
 		checkCompileErrors(m_ID, "PROGRAM");
 
+		glDetachShader(m_ID, vertex);
+		glDetachShader(m_ID, fragment);
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+
+		ProgramCache::store(m_ID, cacheKey);
+		cacheUniforms();
 	}
 
 	void use() {
 		glUseProgram(m_ID);
 	}
 
-	void setBool(std::string name, bool value) const {
-		glUniform1i(glGetUniformLocation(m_ID, name.c_str()), (int)value);
+	// Location resolved when the program was linked, -1 (ignored by glUniform*) if not active
+	GLint location(const std::string& name) const {
+		auto it = m_Uniforms.find(name);
+		return it == m_Uniforms.end() ? -1 : it->second;
 	}
-	void setInt(std::string name, int value) const {
-		glUniform1i(glGetUniformLocation(m_ID, name.c_str()), value);
+
+	void setBool(const std::string& name, bool value) const {
+		glUniform1i(location(name), (int)value);
+	}
+	void setInt(const std::string& name, int value) const {
+		glUniform1i(location(name), value);
 	}
-	void setFloat(std::string name, float value) const {
-		glUniform1f(glGetUniformLocation(m_ID, name.c_str()), value);
+	void setFloat(const std::string& name, float value) const {
+		glUniform1f(location(name), value);
 	}
 
-	void setVec2(std::string name, glm::vec2 value) const {
-		glUniform2fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec2(const std::string& name, glm::vec2 value) const {
+		glUniform2fv(location(name), 1, &(value.x));
 	}
-	void setVec2(std::string name, float x, float y) const {
-		glUniform2f(glGetUniformLocation(m_ID, name.c_str()), x, y);
+	void setVec2(const std::string& name, float x, float y) const {
+		glUniform2f(location(name), x, y);
 	}
 
-	void setVec3(std::string name, glm::vec3 value) const {
-		glUniform3fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec3(const std::string& name, glm::vec3 value) const {
+		glUniform3fv(location(name), 1, &(value.x));
 	}
-	void setVec3(std::string name, float x, float y, float z) const {
-		glUniform3f(glGetUniformLocation(m_ID, name.c_str()), x, y, z);
+	void setVec3(const std::string& name, float x, float y, float z) const {
+		glUniform3f(location(name), x, y, z);
 	}
 
-	void setVec4(std::string name, glm::vec4 value) const {
-		glUniform4fv(glGetUniformLocation(m_ID, name.c_str()), 1, &(value.x));
+	void setVec4(const std::string& name, glm::vec4 value) const {
+		glUniform4fv(location(name), 1, &(value.x));
 	}
-	void setVec4(std::string name, float x, float y, float z, float w) const {
-		glUniform4f(glGetUniformLocation(m_ID, name.c_str()), x, y, z, w);
+	void setVec4(const std::string& name, float x, float y, float z, float w) const {
+		glUniform4f(location(name), x, y, z, w);
 	}
 
-	void setMat2(std::string name, glm::mat2 value) const {
-		glUniformMatrix2fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat2(const std::string& name, glm::mat2 value) const {
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
-	void setMat3(std::string name, glm::mat3 value) const {
-		glUniformMatrix3fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat3(const std::string& name, glm::mat3 value) const {
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
-	void setMat4(std::string name, glm::mat4 value) const {
-		glUniformMatrix4fv(glGetUniformLocation(m_ID, name.c_str()), 1, GL_FALSE, &(value[0].x));
+	void setMat4(const std::string& name, glm::mat4 value) const {
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &(value[0].x));
 	}
 
 private:
+	std::unordered_map<std::string, GLint> m_Uniforms;
+
+	void cacheUniforms() {
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(m_ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(m_ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<GLchar> buffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length;
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(m_ID, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+
+			// Members of uniform blocks have no location
+			std::string name(buffer.data(), length);
+			GLint location = glGetUniformLocation(m_ID, name.c_str());
+			if (location < 0) continue;
+
+			m_Uniforms[name] = location;
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				m_Uniforms[name.substr(0, name.size() - 3)] = location;
+			}
+		}
+	}
+
 	void checkCompileErrors(GLuint shader, std::string type) {
 		GLint success;
 		GLchar infoLog[1024];
@@ -0,0 +1,55 @@
+#ifndef SHADING_H
+#define SHADING_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+#include "ComputeShader.h"
+#include "MarchStats.h"
+#include "Scene.h"
+#include "SceneVariants.h"
+
+// Programs of the lighting pass, shading.glsl, which runs after the ray march:
+// normals, soft shadows toward every light and ambient occlusion, both through
+// the light cache, and the accumulation of jittered samples. Like the ray march
+// it comes specialized per scene and, compiled on first use, in the MARCH_STATS
+// variant that adds its sceneSDF evaluations to the march statistics.
+class Shading {
+public:
+	Shading(const char* path, const std::string& defines)
+		: m_Variants(path, defines), m_StatsVariants(path, defines + MarchStats::defines()) {}
+
+	Shading(const Shading&) = delete;
+	Shading& operator=(const Shading&) = delete;
+
+	void setScene(const Scene& scene, bool compiled) {
+		m_SceneHash = scene.hash();
+		m_Compiled = compiled;
+		m_Shader = &m_Variants.get(scene, compiled);
+	}
+
+	// scene is the one last given to setScene, needed only to compile the
+	// instrumented variant the first time it is asked for
+	ComputeShader& program(const Scene& scene, bool instrumented) {
+		if (!instrumented) return *m_Shader;
+		if (!m_StatsShader || m_StatsHash != m_SceneHash) {
+			m_StatsShader = &m_StatsVariants.get(scene, m_Compiled);
+			m_StatsHash = m_SceneHash;
+		}
+		return *m_StatsShader;
+	}
+
+private:
+	SceneVariants m_Variants;
+	SceneVariants m_StatsVariants;
+	uint64_t m_SceneHash = 0;
+	bool m_Compiled = true;
+	ComputeShader* m_Shader = nullptr;
+	// The instrumented program and the scene it was compiled for
+	ComputeShader* m_StatsShader = nullptr;
+	uint64_t m_StatsHash = 0;
+};
+
+#endif //SHADING_H
@@ -0,0 +1,229 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstdint>
+
+#include "RayStream.h"
+#include "SceneTypes.h"
+#include "SimdPacket.h"
+
+// Packet versions of the SDFs and rayMarch in compute.glsl. F is one of the
+// float wrappers in SimdPacket.h; every function works on F::WIDTH rays at once.
+//
+// Only the SimdMarch*.cpp files include this, each compiled for its own
+// instruction set. Everything here is in an anonymous namespace and calls no
+// inline code from other headers (no glm functions, no std::min), so no
+// function compiled with AVX2 or AVX-512 is shared with the rest of the program
+// through the linker, where it could replace the copy CPUID dispatch relies on.
+namespace {
+
+template<class F>
+struct PacketVec3 {
+	F x, y, z;
+};
+
+template<class F>
+inline F intersectSDF(F distA, F distB)
+{
+	return max(distA, distB);
+}
+
+template<class F>
+inline F unionSDF(F distA, F distB)
+{
+	return min(distA, distB);
+}
+
+template<class F>
+inline F differenceSDF(F distA, F distB)
+{
+	return max(distA, -distB);
+}
+
+template<class F>
+inline F sphereSDF(const PacketVec3<F>& p, float px, float py, float pz, float radius)
+{
+	F x = p.x - F(px);
+	F y = p.y - F(py);
+	F z = p.z - F(pz);
+	return sqrt(x * x + y * y + z * z) - F(radius);
+}
+
+template<class F>
+inline F boxSDF(const PacketVec3<F>& p, float px, float py, float pz, float sx, float sy, float sz)
+{
+	F qx = abs(p.x - F(px)) - F(sx);
+	F qy = abs(p.y - F(py)) - F(sy);
+	F qz = abs(p.z - F(pz)) - F(sz);
+
+	F ox = max(qx, F(0.0f));
+	F oy = max(qy, F(0.0f));
+	F oz = max(qz, F(0.0f));
+	return sqrt(ox * ox + oy * oy + oz * oz) + min(max(qx, max(qy, qz)), F(0.0f));
+}
+
+// Same walk over a postfix program as Scene::evaluate, with a stack of packets
+template<class F>
+inline F evaluateOps(const PacketVec3<F>& p, const SceneOp* ops, unsigned count)
+{
+	F stack[SCENE_STACK_SIZE];
+	int top = 0;
+	for (unsigned i = 0; i < count; i++) {
+		const SceneOp& op = ops[i];
+		switch (op.type) {
+		case OP_SPHERE:
+			stack[top++] = sphereSDF(p, op.params.x, op.params.y, op.params.z, op.params.w);
+			break;
+		case OP_BOX:
+			stack[top++] = boxSDF(p, op.params.x, op.params.y, op.params.z, op.size.x, op.size.y, op.size.z);
+			break;
+		case OP_UNION:
+			top--;
+			stack[top - 1] = unionSDF(stack[top - 1], stack[top]);
+			break;
+		case OP_INTERSECT:
+			top--;
+			stack[top - 1] = intersectSDF(stack[top - 1], stack[top]);
+			break;
+		case OP_DIFFERENCE:
+			top--;
+			stack[top - 1] = differenceSDF(stack[top - 1], stack[top]);
+			break;
+		}
+	}
+	return top > 0 ? stack[0] : F(1000000.0f);
+}
+
+template<class F>
+inline F boundsDistance(const PacketVec3<F>& p, const SceneBvhNode& node)
+{
+	F x = max(max(F(node.min.x) - p.x, p.x - F(node.max.x)), F(0.0f));
+	F y = max(max(F(node.min.y) - p.y, p.y - F(node.max.y)), F(0.0f));
+	F z = max(max(F(node.min.z) - p.z, p.z - F(node.max.z)), F(0.0f));
+	return sqrt(x * x + y * y + z * z);
+}
+
+// BVH traversal of Scene::evaluate for a packet. A node is opened when any lane
+// needs it; lanes that do not keep their own best, and their distance to the
+// children is pushed as unreachable so they never descend.
+template<class F>
+inline F sceneSDF(const PacketVec3<F>& p, const SceneBvhNode* nodes, unsigned nodeCount, const SceneOp* ops)
+{
+	const F unreachable(1e30f);
+
+	F best(1000000.0f);
+	if (nodeCount == 0) return best;
+
+	uint32_t stack[SCENE_BVH_STACK_SIZE];
+	F stackDist[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top] = 0;
+	stackDist[top++] = boundsDistance(p, nodes[0]);
+
+	while (top > 0) {
+		top--;
+		const SceneBvhNode& node = nodes[stack[top]];
+		F dist = stackDist[top];
+
+		typename F::Mask closer = dist < best;
+		if (!any(closer)) continue;
+
+		float ex = node.max.x - node.min.x;
+		float ey = node.max.y - node.min.y;
+		float ez = node.max.z - node.min.z;
+		typename F::Mask far = closer & (dist > sqrt(F(ex * ex + ey * ey + ez * ez)));
+		best = select(far, dist, best);
+
+		typename F::Mask open = andNot(closer, far);
+		if (!any(open)) continue;
+
+		if (node.count > 0) {
+			best = select(open, min(best, evaluateOps(p, ops + node.first, node.count)), best);
+		}
+		else {
+			F left = select(open, boundsDistance(p, nodes[node.first]), unreachable);
+			F right = select(open, boundsDistance(p, nodes[node.first + 1]), unreachable);
+			bool leftFirst = any(andNot(open, right < left));
+			stack[top] = leftFirst ? node.first + 1 : node.first;
+			stackDist[top++] = leftFirst ? right : left;
+			stack[top] = leftFirst ? node.first : node.first + 1;
+			stackDist[top++] = leftFirst ? left : right;
+		}
+	}
+	return best;
+}
+
+template<class F>
+inline void MarchPacket(const float* ox, const float* oy, const float* oz, const float* dx, const float* dy, const float* dz,
+	const SceneBvhNode* nodes, unsigned nodeCount, const SceneOp* ops, float pixelRadius, unsigned lanes, float* distOut, float* stepsOut)
+{
+	const float EPSILON = 0.001f;
+	const int MAX_ITERATIONS = 64;
+	const float MAX_DIST = 1000000.0f;
+
+	static const float laneIndex[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+	PacketVec3<F> position = { F::load(ox), F::load(oy), F::load(oz) };
+	PacketVec3<F> direction = { F::load(dx), F::load(dy), F::load(dz) };
+
+	F travelledDist(0.0f);
+	F result(MAX_DIST);
+	F steps(0.0f);
+	typename F::Mask active = F::load(laneIndex) < F((float)lanes);
+
+	for (int i = 0; i < MAX_ITERATIONS && any(active); i++) {
+		F closestDist = sceneSDF(position, nodes, nodeCount, ops);
+		travelledDist = select(active, travelledDist + closestDist, travelledDist);
+		steps = select(active, steps + F(1.0f), steps);
+
+		typename F::Mask hit = active & (closestDist < max(F(EPSILON), F(pixelRadius) * travelledDist));
+		typename F::Mask escaped = active & (travelledDist > F(MAX_DIST));
+		result = select(hit, travelledDist, result);
+		active = andNot(active, hit | escaped);
+
+		F advance = select(active, closestDist, F(0.0f));
+		position.x = position.x + advance * direction.x;
+		position.y = position.y + advance * direction.y;
+		position.z = position.z + advance * direction.z;
+	}
+
+	result.store(distOut);
+	steps.store(stepsOut);
+}
+
+// Marches the whole stream in packets of F::WIDTH, padding the last partial packet
+template<class F>
+inline void MarchPackets(const RayStream& rays)
+{
+	const unsigned W = F::WIDTH;
+	alignas(64) float pad[6][W];
+	alignas(64) float dist[W];
+	alignas(64) float steps[W];
+
+	for (unsigned first = 0; first < rays.count; first += W) {
+		unsigned lanes = rays.count - first < W ? rays.count - first : W;
+
+		if (lanes == W) {
+			MarchPacket<F>(rays.ox + first, rays.oy + first, rays.oz + first, rays.dx + first, rays.dy + first, rays.dz + first,
+				rays.nodes, rays.nodeCount, rays.ops, rays.pixelRadius, W, dist, steps);
+		}
+		else {
+			const float* src[6] = { rays.ox, rays.oy, rays.oz, rays.dx, rays.dy, rays.dz };
+			for (int c = 0; c < 6; c++) {
+				for (unsigned l = 0; l < W; l++) {
+					pad[c][l] = l < lanes ? src[c][first + l] : 0.0f;
+				}
+			}
+			MarchPacket<F>(pad[0], pad[1], pad[2], pad[3], pad[4], pad[5], rays.nodes, rays.nodeCount, rays.ops, rays.pixelRadius, lanes, dist, steps);
+		}
+
+		for (unsigned l = 0; l < lanes; l++) {
+			rays.dist[first + l] = dist[l];
+			rays.steps[first + l] = (int)steps[l];
+		}
+	}
+}
+
+} // namespace
+
+#endif //SIMD_KERNELS_H
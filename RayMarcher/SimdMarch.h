@@ -0,0 +1,94 @@
+#ifndef SIMD_MARCH_H
+#define SIMD_MARCH_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "RayStream.h"
+
+enum SimdIsa {
+	ISA_SCALAR,
+	ISA_SSE,
+	ISA_AVX2,
+	ISA_AVX512
+};
+
+inline void Cpuid(int leaf, int subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline unsigned long long Xgetbv(unsigned index)
+{
+#if defined(_MSC_VER)
+	return _xgetbv(index);
+#else
+	unsigned eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+inline SimdIsa DetectSimdIsa()
+{
+	unsigned regs[4];
+	Cpuid(0, 0, regs);
+	unsigned maxLeaf = regs[0];
+
+	Cpuid(1, 0, regs);
+	bool osxsave = (regs[2] >> 27) & 1;
+	bool fma = (regs[2] >> 12) & 1;
+	if (!osxsave || maxLeaf < 7) return ISA_SSE;
+
+	// The OS has to save the wider registers on context switches, not just the CPU support them
+	unsigned long long xcr0 = Xgetbv(0);
+	bool avxState = (xcr0 & 0x6) == 0x6;
+	bool avx512State = (xcr0 & 0xE6) == 0xE6;
+
+	Cpuid(7, 0, regs);
+	bool avx2 = (regs[1] >> 5) & 1;
+	bool avx512 = ((regs[1] >> 16) & 1) && ((regs[1] >> 17) & 1) && ((regs[1] >> 28) & 1) && ((regs[1] >> 30) & 1) && ((regs[1] >> 31) & 1);
+
+	if (avx512 && avx512State) return ISA_AVX512;
+	if (avx2 && fma && avxState) return ISA_AVX2;
+	return ISA_SSE;
+}
+
+inline const char* SimdIsaName(SimdIsa isa)
+{
+	switch (isa) {
+	case ISA_SSE: return "SSE";
+	case ISA_AVX2: return "AVX2";
+	case ISA_AVX512: return "AVX-512";
+	default: return "scalar";
+	}
+}
+
+inline unsigned SimdIsaWidth(SimdIsa isa)
+{
+	switch (isa) {
+	case ISA_SSE: return 4;
+	case ISA_AVX2: return 8;
+	case ISA_AVX512: return 16;
+	default: return 1;
+	}
+}
+
+inline MarchPacketsFn SelectMarchPackets(SimdIsa isa)
+{
+	switch (isa) {
+	case ISA_SSE: return MarchPacketsSSE;
+	case ISA_AVX2: return MarchPacketsAVX2;
+	case ISA_AVX512: return MarchPacketsAVX512;
+	default: return nullptr;
+	}
+}
+
+#endif //SIMD_MARCH_H
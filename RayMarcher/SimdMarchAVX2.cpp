@@ -0,0 +1,10 @@
+#if !defined(__AVX2__)
+#error "SimdMarchAVX2.cpp has to be compiled with /arch:AVX2"
+#endif
+
+#include "SimdKernels.h"
+
+void MarchPacketsAVX2(const RayStream& rays)
+{
+	MarchPackets<FloatAVX2>(rays);
+}
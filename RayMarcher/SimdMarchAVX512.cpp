@@ -0,0 +1,10 @@
+#if !defined(__AVX512F__)
+#error "SimdMarchAVX512.cpp has to be compiled with /arch:AVX512"
+#endif
+
+#include "SimdKernels.h"
+
+void MarchPacketsAVX512(const RayStream& rays)
+{
+	MarchPackets<FloatAVX512>(rays);
+}
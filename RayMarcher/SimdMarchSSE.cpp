@@ -0,0 +1,6 @@
+#include "SimdKernels.h"
+
+void MarchPacketsSSE(const RayStream& rays)
+{
+	MarchPackets<FloatSSE>(rays);
+}
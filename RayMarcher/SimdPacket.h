@@ -0,0 +1,123 @@
+#ifndef SIMD_PACKET_H
+#define SIMD_PACKET_H
+
+#include <immintrin.h>
+
+// Thin wrappers around the SSE/AVX2/AVX-512 float registers so the march kernels
+// in SimdKernels.h can be written once. Only the wrappers enabled by the current
+// translation unit's /arch flags are compiled. Internal to every translation
+// unit that includes it, see SimdKernels.h.
+namespace {
+
+struct MaskSSE {
+	__m128 m;
+};
+
+inline MaskSSE operator&(MaskSSE a, MaskSSE b) { return { _mm_and_ps(a.m, b.m) }; }
+inline MaskSSE operator|(MaskSSE a, MaskSSE b) { return { _mm_or_ps(a.m, b.m) }; }
+inline MaskSSE andNot(MaskSSE a, MaskSSE b) { return { _mm_andnot_ps(b.m, a.m) }; }
+inline bool any(MaskSSE a) { return _mm_movemask_ps(a.m) != 0; }
+
+struct FloatSSE {
+	typedef MaskSSE Mask;
+	static constexpr unsigned WIDTH = 4;
+
+	__m128 v;
+
+	FloatSSE() {}
+	FloatSSE(__m128 v) : v(v) {}
+	FloatSSE(float s) : v(_mm_set1_ps(s)) {}
+
+	static FloatSSE load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline FloatSSE operator+(FloatSSE a, FloatSSE b) { return _mm_add_ps(a.v, b.v); }
+inline FloatSSE operator-(FloatSSE a, FloatSSE b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatSSE operator*(FloatSSE a, FloatSSE b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatSSE operator-(FloatSSE a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline FloatSSE min(FloatSSE a, FloatSSE b) { return _mm_min_ps(a.v, b.v); }
+inline FloatSSE max(FloatSSE a, FloatSSE b) { return _mm_max_ps(a.v, b.v); }
+inline FloatSSE sqrt(FloatSSE a) { return _mm_sqrt_ps(a.v); }
+inline FloatSSE abs(FloatSSE a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline MaskSSE operator<(FloatSSE a, FloatSSE b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline MaskSSE operator>(FloatSSE a, FloatSSE b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline FloatSSE select(MaskSSE m, FloatSSE a, FloatSSE b) { return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)); }
+
+#if defined(__AVX2__)
+struct MaskAVX2 {
+	__m256 m;
+};
+
+inline MaskAVX2 operator&(MaskAVX2 a, MaskAVX2 b) { return { _mm256_and_ps(a.m, b.m) }; }
+inline MaskAVX2 operator|(MaskAVX2 a, MaskAVX2 b) { return { _mm256_or_ps(a.m, b.m) }; }
+inline MaskAVX2 andNot(MaskAVX2 a, MaskAVX2 b) { return { _mm256_andnot_ps(b.m, a.m) }; }
+inline bool any(MaskAVX2 a) { return _mm256_movemask_ps(a.m) != 0; }
+
+struct FloatAVX2 {
+	typedef MaskAVX2 Mask;
+	static constexpr unsigned WIDTH = 8;
+
+	__m256 v;
+
+	FloatAVX2() {}
+	FloatAVX2(__m256 v) : v(v) {}
+	FloatAVX2(float s) : v(_mm256_set1_ps(s)) {}
+
+	static FloatAVX2 load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline FloatAVX2 operator+(FloatAVX2 a, FloatAVX2 b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatAVX2 operator-(FloatAVX2 a, FloatAVX2 b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatAVX2 operator*(FloatAVX2 a, FloatAVX2 b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatAVX2 operator-(FloatAVX2 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline FloatAVX2 min(FloatAVX2 a, FloatAVX2 b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatAVX2 max(FloatAVX2 a, FloatAVX2 b) { return _mm256_max_ps(a.v, b.v); }
+inline FloatAVX2 sqrt(FloatAVX2 a) { return _mm256_sqrt_ps(a.v); }
+inline FloatAVX2 abs(FloatAVX2 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline MaskAVX2 operator<(FloatAVX2 a, FloatAVX2 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline MaskAVX2 operator>(FloatAVX2 a, FloatAVX2 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline FloatAVX2 select(MaskAVX2 m, FloatAVX2 a, FloatAVX2 b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+#endif
+
+#if defined(__AVX512F__)
+struct MaskAVX512 {
+	__mmask16 m;
+};
+
+inline MaskAVX512 operator&(MaskAVX512 a, MaskAVX512 b) { return { (__mmask16)(a.m & b.m) }; }
+inline MaskAVX512 operator|(MaskAVX512 a, MaskAVX512 b) { return { (__mmask16)(a.m | b.m) }; }
+inline MaskAVX512 andNot(MaskAVX512 a, MaskAVX512 b) { return { (__mmask16)(a.m & ~b.m) }; }
+inline bool any(MaskAVX512 a) { return a.m != 0; }
+
+struct FloatAVX512 {
+	typedef MaskAVX512 Mask;
+	static constexpr unsigned WIDTH = 16;
+
+	__m512 v;
+
+	FloatAVX512() {}
+	FloatAVX512(__m512 v) : v(v) {}
+	FloatAVX512(float s) : v(_mm512_set1_ps(s)) {}
+
+	static FloatAVX512 load(const float* p) { return _mm512_loadu_ps(p); }
+	void store(float* p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline FloatAVX512 operator+(FloatAVX512 a, FloatAVX512 b) { return _mm512_add_ps(a.v, b.v); }
+inline FloatAVX512 operator-(FloatAVX512 a, FloatAVX512 b) { return _mm512_sub_ps(a.v, b.v); }
+inline FloatAVX512 operator*(FloatAVX512 a, FloatAVX512 b) { return _mm512_mul_ps(a.v, b.v); }
+inline FloatAVX512 operator-(FloatAVX512 a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+inline FloatAVX512 min(FloatAVX512 a, FloatAVX512 b) { return _mm512_min_ps(a.v, b.v); }
+inline FloatAVX512 max(FloatAVX512 a, FloatAVX512 b) { return _mm512_max_ps(a.v, b.v); }
+inline FloatAVX512 sqrt(FloatAVX512 a) { return _mm512_sqrt_ps(a.v); }
+inline FloatAVX512 abs(FloatAVX512 a) { return _mm512_abs_ps(a.v); }
+inline MaskAVX512 operator<(FloatAVX512 a, FloatAVX512 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline MaskAVX512 operator>(FloatAVX512 a, FloatAVX512 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline FloatAVX512 select(MaskAVX512 m, FloatAVX512 a, FloatAVX512 b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+#endif
+
+} // namespace
+
+#endif //SIMD_PACKET_H
@@ -0,0 +1,141 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Trace.h"
+
+// Fixed set of workers, each with its own task deque. A worker pops from the
+// back of its own deque and steals from the front of the others when it runs dry.
+class ThreadPool {
+public:
+	ThreadPool(unsigned threadCount = std::thread::hardware_concurrency()) {
+		if (threadCount == 0) threadCount = 1;
+
+		for (unsigned i = 0; i < threadCount; i++) {
+			m_Queues.push_back(std::make_unique<WorkQueue>());
+		}
+		for (unsigned i = 0; i < threadCount; i++) {
+			m_Threads.emplace_back(&ThreadPool::workerLoop, this, i);
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_WorkReady.notify_all();
+		for (std::thread& thread : m_Threads) {
+			thread.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned size() const {
+		return (unsigned)m_Threads.size();
+	}
+
+	// Runs job(i) for every i in [0, count) and blocks until all of them have finished.
+	void parallelFor(unsigned count, const std::function<void(unsigned)>& job) {
+		if (count == 0) return;
+
+		m_Job = &job;
+		m_Remaining = count;
+
+		// Hand out contiguous runs so neighbouring tasks start on the same worker
+		unsigned workers = size();
+		for (unsigned w = 0; w < workers; w++) {
+			unsigned begin = count * w / workers;
+			unsigned end = count * (w + 1) / workers;
+
+			std::lock_guard<std::mutex> lock(m_Queues[w]->mutex);
+			for (unsigned i = begin; i < end; i++) {
+				m_Queues[w]->tasks.push_back(i);
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Generation++;
+		}
+		m_WorkReady.notify_all();
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_WorkDone.wait(lock, [this] { return m_Remaining == 0; });
+	}
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<unsigned> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+	std::vector<std::thread> m_Threads;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::condition_variable m_WorkDone;
+	const std::function<void(unsigned)>* m_Job = nullptr;
+	std::atomic<unsigned> m_Remaining{ 0 };
+	unsigned m_Generation = 0;
+	bool m_Stop = false;
+
+	bool popLocal(unsigned worker, unsigned& task) {
+		WorkQueue& queue = *m_Queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) return false;
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(unsigned worker, unsigned& task) {
+		unsigned workers = size();
+		for (unsigned offset = 1; offset < workers; offset++) {
+			WorkQueue& queue = *m_Queues[(worker + offset) % workers];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty()) {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void workerLoop(unsigned worker) {
+		Trace::setThreadName("worker " + std::to_string(worker));
+		unsigned seenGeneration = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WorkReady.wait(lock, [&] { return m_Stop || m_Generation != seenGeneration; });
+				if (m_Stop) return;
+				seenGeneration = m_Generation;
+			}
+
+			PROFILE_SCOPE("work");
+			unsigned task;
+			while (popLocal(worker, task) || steal(worker, task)) {
+				(*m_Job)(task);
+				if (--m_Remaining == 0) {
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					m_WorkDone.notify_all();
+				}
+			}
+		}
+	}
+};
+
+#endif //THREAD_POOL_H
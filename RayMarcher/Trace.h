@@ -0,0 +1,175 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Json.h"
+
+// Records PROFILE_SCOPE spans on every thread and GPU pass times from
+// GpuProfiler, and writes them in the Chrome trace event format (chrome://tracing,
+// ui.perfetto.dev) with the CPU threads and the GPU as separate processes on one
+// time axis; GpuProfiler feeds and calibrates the GPU side, so this header needs
+// no GL. Each thread appends to its own buffer, so a scope takes no lock;
+// while tracing is off a scope is a single relaxed load. Building with
+// NO_PROFILING removes the scopes altogether.
+class Trace {
+public:
+	static void start() {
+		s_Epoch = std::chrono::steady_clock::now();
+		s_Enabled.store(true, std::memory_order_relaxed);
+	}
+
+	static bool enabled() {
+		return s_Enabled.load(std::memory_order_relaxed);
+	}
+
+	// Nanoseconds since start()
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_Epoch).count();
+	}
+
+	// Names the calling thread in the trace
+	static void setThreadName(const std::string& name) {
+		if (!enabled()) return;
+		buffer().name = name;
+	}
+
+	static void addCpu(const char* name, int64_t begin, int64_t end) {
+		ThreadBuffer& thread = buffer();
+		if (thread.events.size() < MAX_EVENTS) {
+			thread.events.push_back({ name, begin, end - begin });
+		}
+		else {
+			thread.dropped++;
+		}
+	}
+
+	// Maps GPU timestamps onto the trace clock, given the GPU clock in nanoseconds
+	// read just now
+	static void calibrateGpu(int64_t gpuNow) {
+		if (!enabled()) return;
+		s_GpuOffset = now() - gpuNow;
+		s_GpuCalibrated = true;
+	}
+
+	// A pass timed on the GPU clock, begin and end in nanoseconds
+	static void addGpu(const std::string& name, uint64_t begin, uint64_t end) {
+		if (!s_GpuCalibrated) return;
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		if (s_GpuEvents.size() >= MAX_EVENTS) return;
+		const char* interned = s_Names.insert(name).first->c_str();
+		s_GpuEvents.push_back({ interned, (int64_t)begin + s_GpuOffset, (int64_t)(end - begin) });
+	}
+
+	// Call with no scopes open on other threads, e.g. at exit or between frames
+	static bool write(const std::string& path) {
+		std::ofstream file(path);
+		if (!file) return false;
+
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << CPU_PID << ", \"args\": {\"name\": \"CPU\"}},\n";
+		file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << GPU_PID << ", \"args\": {\"name\": \"GPU\"}}";
+
+		for (const std::shared_ptr<ThreadBuffer>& thread : s_Threads) {
+			std::string name = thread->name.empty() ? "thread " + std::to_string(thread->id) : thread->name;
+			file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << CPU_PID << ", \"tid\": " << thread->id
+				<< ", \"args\": {\"name\": " << JsonString(name) << "}}";
+			writeEvents(file, CPU_PID, thread->id, thread->events);
+			if (thread->dropped) {
+				std::cout << "Trace: " << name << " dropped " << thread->dropped << " events" << std::endl;
+			}
+		}
+		writeEvents(file, GPU_PID, 0, s_GpuEvents);
+		file << "\n]}\n";
+		return (bool)file;
+	}
+
+private:
+	struct Event {
+		const char* name;
+		int64_t begin;
+		int64_t duration;
+	};
+
+	struct ThreadBuffer {
+		unsigned id;
+		std::string name;
+		std::vector<Event> events;
+		uint64_t dropped = 0;
+	};
+
+	static const int CPU_PID = 1;
+	static const int GPU_PID = 2;
+	// Per thread, about 24 MB; later events are counted and dropped
+	static const size_t MAX_EVENTS = 1 << 20;
+
+	static inline std::atomic<bool> s_Enabled{ false };
+	static inline std::chrono::steady_clock::time_point s_Epoch;
+	static inline std::mutex s_Mutex;
+	static inline std::vector<std::shared_ptr<ThreadBuffer>> s_Threads;
+	static inline std::vector<Event> s_GpuEvents;
+	static inline std::set<std::string> s_Names;
+	static inline int64_t s_GpuOffset = 0;
+	static inline bool s_GpuCalibrated = false;
+
+	// The registry shares ownership so events survive the thread
+	static ThreadBuffer& buffer() {
+		thread_local std::shared_ptr<ThreadBuffer> local = [] {
+			std::lock_guard<std::mutex> lock(s_Mutex);
+			auto thread = std::make_shared<ThreadBuffer>();
+			thread->id = (unsigned)s_Threads.size();
+			s_Threads.push_back(thread);
+			return thread;
+		}();
+		return *local;
+	}
+
+	static void writeEvents(std::ofstream& file, int pid, unsigned tid, const std::vector<Event>& events) {
+		for (const Event& event : events) {
+			file << ",\n{\"name\": " << JsonString(event.name) << ", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << tid
+				<< ", \"ts\": " << event.begin / 1e3 << ", \"dur\": " << event.duration / 1e3 << "}";
+		}
+	}
+};
+
+// Records the span from construction to destruction while tracing is on
+class TraceScope {
+public:
+	TraceScope(const char* name) : m_Name(Trace::enabled() ? name : nullptr) {
+		if (m_Name) m_Begin = Trace::now();
+	}
+
+	~TraceScope() {
+		if (m_Name) Trace::addCpu(m_Name, m_Begin, Trace::now());
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* m_Name;
+	int64_t m_Begin = 0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// name must outlive the trace, e.g. a string literal
+#ifdef NO_PROFILING
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif //TRACE_H
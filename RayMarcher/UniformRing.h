@@ -0,0 +1,69 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <vector>
+
+// Persistently mapped uniform buffer split into one slot per frame in flight.
+// push() waits until the GPU has finished with the next slot, copies the value
+// in and binds that slot; fence() marks the slot as in use by the commands
+// issued since.
+template<class T>
+class UniformRing {
+public:
+	UniformRing(GLuint binding, unsigned slots = 3) : m_Binding(binding), m_Fences(slots, nullptr) {
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		m_Stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferStorage(GL_UNIFORM_BUFFER, m_Stride * slots, NULL, flags);
+		m_Mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, m_Stride * slots, flags);
+	}
+
+	~UniformRing() {
+		for (GLsync fence : m_Fences) {
+			if (fence) glDeleteSync(fence);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	void push(const T& value) {
+		m_Slot = (m_Slot + 1) % m_Fences.size();
+
+		GLsync& fence = m_Fences[m_Slot];
+		if (fence) {
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, ~GLuint64(0));
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		std::memcpy(m_Mapped + m_Slot * m_Stride, &value, sizeof(T));
+		glBindBufferRange(GL_UNIFORM_BUFFER, m_Binding, m_Buffer, m_Slot * m_Stride, sizeof(T));
+	}
+
+	void fence() {
+		GLsync& fence = m_Fences[m_Slot];
+		if (fence) glDeleteSync(fence);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+private:
+	GLuint m_Binding;
+	GLuint m_Buffer = 0;
+	GLsizeiptr m_Stride = 0;
+	char* m_Mapped = nullptr;
+	std::vector<GLsync> m_Fences;
+	size_t m_Slot = 0;
+};
+
+#endif //UNIFORM_RING_H
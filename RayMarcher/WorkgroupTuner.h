@@ -0,0 +1,126 @@
+#ifndef WORKGROUP_TUNER_H
+#define WORKGROUP_TUNER_H
+
+#include <glad/glad.h>
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ComputeShader.h"
+
+struct WorkgroupSize {
+	GLint x;
+	GLint y;
+};
+
+// Picks the compute workgroup tile size by timing candidates on the current
+// device. Results are stored per GL_RENDERER/GL_VERSION in a small text file so
+// the timing only runs once per device and driver.
+class WorkgroupTuner {
+public:
+	WorkgroupTuner(const std::string& cachePath) : m_CachePath(cachePath) {
+		m_Device = std::string((const char*)glGetString(GL_RENDERER)) + " | " + (const char*)glGetString(GL_VERSION);
+	}
+
+	static std::string defines(WorkgroupSize size) {
+		return ShaderDefine("LOCAL_SIZE_X", size.x) + ShaderDefine("LOCAL_SIZE_Y", size.y);
+	}
+
+	// Returns the cached size for this device, or times every candidate that fits the
+	// device limits and caches the fastest. Candidates are compiled with defines on top
+	// of their size, setUniforms is called before each timed run.
+	WorkgroupSize tune(const char* shaderPath, const std::string& defines, GLuint width, GLuint height, const std::function<void(ComputeShader&)>& setUniforms, bool force = false) {
+		WorkgroupSize size;
+		if (!force && lookup(size)) {
+			std::cout << "Workgroup size " << size.x << "x" << size.y << " (cached)" << std::endl;
+			return size;
+		}
+
+		GLint maxInvocations, maxX, maxY;
+		glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxX);
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &maxY);
+
+		const WorkgroupSize candidates[] = { {8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 4}, {32, 8}, {64, 1}, {64, 4} };
+
+		GLuint query;
+		glGenQueries(1, &query);
+
+		size = { 8, 8 };
+		GLuint64 best = ~GLuint64(0);
+		for (const WorkgroupSize& candidate : candidates) {
+			if (candidate.x * candidate.y > maxInvocations || candidate.x > maxX || candidate.y > maxY) continue;
+
+			ComputeShader shader(shaderPath, defines + WorkgroupTuner::defines(candidate));
+			shader.use();
+			setUniforms(shader);
+
+			// First dispatch warms up the pipeline, the rest are timed
+			shader.dispatchPixels(width, height);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (int i = 0; i < RUNS; i++) {
+				shader.dispatchPixels(width, height);
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			glDeleteProgram(shader.m_ID);
+
+			std::cout << "Workgroup size " << candidate.x << "x" << candidate.y << ": " << elapsed / RUNS / 1e6 << " ms" << std::endl;
+			if (elapsed < best) {
+				best = elapsed;
+				size = candidate;
+			}
+		}
+		glDeleteQueries(1, &query);
+
+		std::cout << "Workgroup size " << size.x << "x" << size.y << " selected" << std::endl;
+		store(size);
+		return size;
+	}
+
+private:
+	static const int RUNS = 8;
+
+	std::string m_CachePath;
+	std::string m_Device;
+
+	bool lookup(WorkgroupSize& size) const {
+		std::ifstream file(m_CachePath);
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t tab = line.rfind('\t');
+			if (tab == std::string::npos || line.substr(0, tab) != m_Device) continue;
+
+			std::istringstream stream(line.substr(tab + 1));
+			if (stream >> size.x >> size.y) return true;
+		}
+		return false;
+	}
+
+	void store(WorkgroupSize size) const {
+		std::vector<std::string> lines;
+		{
+			std::ifstream file(m_CachePath);
+			std::string line;
+			while (std::getline(file, line)) {
+				size_t tab = line.rfind('\t');
+				if (tab != std::string::npos && line.substr(0, tab) != m_Device) lines.push_back(line);
+			}
+		}
+
+		std::ofstream file(m_CachePath);
+		for (const std::string& line : lines) {
+			file << line << "\n";
+		}
+		file << m_Device << "\t" << size.x << " " << size.y << "\n";
+	}
+};
+
+#endif //WORKGROUP_TUNER_H
@@ -1,19 +1,38 @@
 #version 460 core
-layout (local_size_x = 1, local_size_y = 1) in;
-layout (binding = 0, rgba32f) uniform image2D image;
-
-#define PI 3.1415926535
-#define EPSILON 0.001
-#define MAX_ITERATIONS 64
-#define MAX_DIST 1000000
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+layout (binding = 1, r32f) uniform readonly image2D coneDistances;
+layout (binding = 2, r32f) uniform writeonly image2D depth;
+layout (binding = 3, r32ui) uniform readonly uimage2D reprojected;
+
+#include "scene.glsl"
+#include "stats.glsl"
+
+// The instrumented variant stores the step count, termination reason and
+// sceneSDF evaluations of every pixel, and sums them with a histogram of step
+// counts into MarchCounters
+#ifdef MARCH_STATS
+layout (binding = 4, rg32ui) uniform writeonly uimage2D marchStats;
+
+uint termination;
+#define TERMINATE(reason) termination = reason
+#else
+#define TERMINATE(reason)
+#endif
+
+// Share of the reprojected distance a ray skips, the rest absorbs the change in view
+#define REPROJECT_FRACTION 0.9
 
 const float fovh = PI/2;
 float fovv;
 
 //uniform vec3 viewDirection;
 //uniform vec3 viewPosition;
-uniform mat4 cameraToWorld;
-uniform mat4 invProjection;
 
 struct Camera {
 	vec3 position;
@@ -25,92 +44,71 @@ struct Ray {
 	vec3 direction;
 };
 
-float intersectSDF(float distA, float distB)
-{
-	return max(distA, distB);
-}
-
-float unionSDF(float distA, float distB)
-{
-	return min(distA, distB);
-}
-
-float differenceSDF(float distA, float distB)
-{
-	return max(distA, -distB);
-}
-
-float sphereSDF(vec3 p, vec3 pos, float radius)
-{
-	p = p - pos;
-	return length(p) - radius;
-}
-
-float boxSDF(vec3 p, vec3 pos, vec3 size)
-{
-	p = p - pos;
-	vec3 q = abs(p) - size;
-	return length(max(q, 0)) + min(max(q.x, max(q.y, q.z)), 0);
-}
-
-
-float sceneSDF(vec3 p)
-{
-	float sphere = sphereSDF(p, vec3(10, 0, 0), 1.2);
-	float cube = boxSDF(p, vec3(10, 0, 0), vec3(1));
-	return intersectSDF(sphere, cube);
-}
-
-vec3 estimateNormal(vec3 p)
+// Marches from start along the ray; start is known to be in empty space. With
+// relaxation above 1 this is over-relaxed sphere tracing: steps are stretched to
+// relaxation * d, which is only safe while the unbounding spheres of consecutive
+// steps overlap. When they don't, the last step is taken back and tracing goes on
+// unrelaxed.
+float rayMarch(Ray ray, float start, out int steps)
 {
-	return normalize(vec3(sceneSDF(vec3(p.x + EPSILON, p.yz)) - sceneSDF(vec3(p.x - EPSILON, p.yz)),
-					 sceneSDF(vec3(p.x, p.y + EPSILON, p.z)) - sceneSDF(vec3(p.x, p.y - EPSILON, p.z)),
-					 sceneSDF(vec3(p.xy, p.z + EPSILON)) - sceneSDF(vec3(p.xy, p.z - EPSILON))));
-}
+	float omega = relaxation;
+	float travelledDist = start;
+	float previousDist = 0;
+	float stepLength = 0;
+	for (steps = 1; steps <= maxIterations; steps++) {
+		float closestDist = marchSDF(ray.origin + travelledDist * ray.direction);
+		COUNT_EVALUATIONS(1);
+
+		bool overshot = omega > 1 && abs(closestDist) + previousDist < stepLength;
+		if (overshot) {
+			// Back to where an unrelaxed step from the previous point would have landed
+			stepLength = previousDist - stepLength;
+			omega = 1;
+		}
+		else {
+			stepLength = omega * closestDist;
+			previousDist = abs(closestDist);
+
+			if (closestDist < hitEpsilon(travelledDist)) {
+				TERMINATE(TERMINATION_HIT);
+				return travelledDist;
+			}
+		}
 
-float rayMarch(Ray ray)
-{
-	float closestDist = MAX_DIST;
-	float travelledDist = 0;
-	vec3 position = ray.origin;
-	for (int i = 0; i < MAX_ITERATIONS; i++) {
-		closestDist = sceneSDF(position);
-		travelledDist += closestDist;
-
-		if (closestDist < EPSILON) {
-			return travelledDist;
-		} else if (travelledDist > MAX_DIST) {
+		travelledDist += stepLength;
+		if (travelledDist > MAX_DIST) {
+			TERMINATE(TERMINATION_MAX_DIST);
 			return MAX_DIST;
 		}
-
-		position += closestDist * ray.direction;
 	}
+	steps = maxIterations;
+	TERMINATE(TERMINATION_MAX_ITERATIONS);
 	return MAX_DIST;
 }
 
-
-void shading(vec2 pixel, Ray ray, float dist)
+// Start distance from the previous frame reprojected by reproject.glsl. The
+// nearest value around the pixel fills the cracks the scatter leaves; a pixel
+// with nothing reprojected around it (disocclusion) or a start point inside a
+// surface falls back to 0.
+float reprojectedStart(Ray ray, ivec2 pixel)
 {
-	if (dist != MAX_DIST) {
-		vec3 p = ray.origin + dist * ray.direction;
-
-		const int numLights = 3;
-		vec3 light[numLights] = {vec3(4, 10, -10), vec3(4, 10, 10), vec3(-5, 10, 10)};
-
-		vec3 normal = estimateNormal(p);
-
-		vec4 color;
-		for (int i = 0; i < numLights; i++) {
-			color += vec4(max(dot(normalize(light[i] - p), normal), 0) * vec3(0.3, 0.4, 1.0), 1.0);
+	uint nearest = 0xFFFFFFFFu;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), ivec2(resolution) - 1);
+			nearest = min(nearest, imageLoad(reprojected, neighbour).r);
 		}
-
-		imageStore(image, ivec2(pixel), color);
 	}
-	else {
-		imageStore(image, ivec2(pixel), vec4(0.7, 0.7, 0.9, 1.0));
+	if (nearest == 0xFFFFFFFFu) {
+		return 0;
 	}
+
+	float start = REPROJECT_FRACTION * uintBitsToFloat(nearest);
+	COUNT_EVALUATIONS(1);
+	return marchSDF(ray.origin + start * ray.direction) > 0 ? start : 0;
 }
 
+
 vec3 erot(vec3 p, vec3 ax, float ro)
 {
 	return mix(dot(p, ax)*ax, p, cos(ro)) + sin(ro)*cross(ax, p);
@@ -118,20 +116,40 @@ vec3 erot(vec3 p, vec3 ax, float ro)
 
 void main()
 {
-	vec2 dims = imageSize(image);
+	if (any(greaterThanEqual(gl_GlobalInvocationID.xy, uvec2(resolution)))) {
+		return;
+	}
+
+	vec2 dims = resolution;
 	vec2 pixel = gl_GlobalInvocationID.xy;
 
 	//Camera camera = Camera(viewPosition, viewDirection);
 
 
 	vec3 origin = (cameraToWorld * vec4(0, 0, 0, 1)).xyz;
-	vec3 direction = (invProjection * vec4(2*pixel.x/dims.x - 1, 2*pixel.y/dims.y - 1, 0, 1)).xyz;
-	direction = (cameraToWorld * vec4(direction, 0)).xyz;
-	direction = normalize(direction);
+	vec3 direction = pixelDirection(pixel + jitter);
 
 	Ray ray = Ray(origin, direction);
-	
-	float dist = rayMarch(ray);
-	shading(pixel, ray, dist);
+
+	float start = useCone ? imageLoad(coneDistances, ivec2(pixel) / CONE_TILE).r : 0;
+	if (useReprojection) {
+		start = max(start, reprojectedStart(ray, ivec2(pixel)));
+	}
+
+	int steps;
+	float dist = rayMarch(ray, start, steps);
+	// shading.glsl lights the hit from here, reproject.glsl warm starts the next frame
+	imageStore(depth, ivec2(pixel), vec4(dist));
+
+	if (countSteps) {
+		atomicAdd(totalSteps, uint(steps));
+	}
+
+#ifdef MARCH_STATS
+	imageStore(marchStats, ivec2(pixel), uvec4(uint(steps) | termination << 30, sdfEvaluations, 0, 0));
+	atomicAdd(terminations[termination], 1u);
+	atomicAdd(evaluations, sdfEvaluations);
+	atomicAdd(histogram[min(uint(steps - 1) * MARCH_STATS_BINS / uint(maxIterations), MARCH_STATS_BINS - 1u)], 1u);
+#endif
 	//imageStore(image, ivec2(pixel), vec4(direction, 1));
 }
\ No newline at end of file
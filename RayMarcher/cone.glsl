@@ -0,0 +1,47 @@
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8) in;
+layout (binding = 1, r32f) uniform writeonly image2D coneDistances;
+
+#include "scene.glsl"
+
+// One invocation per CONE_TILE x CONE_TILE tile of the image. Marches a cone
+// that contains the primary rays of every pixel in the tile and stores how far
+// along it is known to be empty; compute.glsl starts those rays there.
+void main()
+{
+	ivec2 tiles = (ivec2(resolution) + CONE_TILE - 1) / CONE_TILE;
+	ivec2 tile = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(tile, tiles))) {
+		return;
+	}
+
+	// The whole frame shares one jitter, the cone shifts with its rays
+	vec2 first = vec2(tile * CONE_TILE) + jitter;
+	vec2 last = min(first + float(CONE_TILE - 1), resolution - 1.0 + jitter);
+
+	vec3 origin = (cameraToWorld * vec4(0, 0, 0, 1)).xyz;
+	vec3 axis = pixelDirection(0.5 * (first + last));
+
+	float cosAngle = min(min(dot(axis, pixelDirection(first)), dot(axis, pixelDirection(last))),
+						 min(dot(axis, pixelDirection(vec2(first.x, last.y))), dot(axis, pixelDirection(vec2(last.x, first.y)))));
+	float tanAngle = sqrt(max(1 - cosAngle * cosAngle, 0)) / cosAngle;
+
+	// The empty sphere around the axis point at t covers the cone up to t + advance
+	// as long as advance + (t + advance) * tanAngle <= dist, so every pixel ray can
+	// start at the final t
+	float t = 0;
+	int steps;
+	for (steps = 1; steps <= maxIterations; steps++) {
+		float advance = (marchSDF(origin + t * axis) - t * tanAngle) / (1 + tanAngle);
+		if (advance < hitEpsilon(t) || t > MAX_DIST) {
+			break;
+		}
+		t += advance;
+	}
+
+	imageStore(coneDistances, tile, vec4(min(t, MAX_DIST)));
+
+	if (countSteps) {
+		atomicAdd(totalSteps, uint(min(steps, maxIterations)));
+	}
+}
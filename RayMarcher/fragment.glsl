@@ -3,8 +3,11 @@
 in vec2 TexCoord;
 
 uniform sampler2D Texture;
+// Part of the texture holding the image when rendering below full resolution
+uniform vec2 uvScale = vec2(1.0);
 
 void main()
 {
-	gl_FragColor = texture(Texture, TexCoord);
+	vec2 uv = min(TexCoord * uvScale, uvScale - 0.5 / vec2(textureSize(Texture, 0)));
+	gl_FragColor = texture(Texture, uv);
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 460 core
+#ifndef IMAGE_FORMAT
+#define IMAGE_FORMAT rgba32f
+#endif
+layout (local_size_x = 8, local_size_y = 8) in;
+layout (binding = 0, IMAGE_FORMAT) uniform writeonly image2D image;
+layout (binding = 4, rg32ui) uniform readonly uimage2D marchStats;
+
+#include "scene.glsl"
+
+// 1 shows steps, 2 sceneSDF evaluations, both relative to maxIterations
+uniform int mode;
+
+// Blue through green and yellow to red
+vec3 heat(float x)
+{
+	x = clamp(x, 0, 1);
+	return clamp(vec3(4 * x - 2, x < 0.5 ? 2 * x : 2 - 2 * x, 1 - 2 * x) + vec3(0, 0.2, 0), 0, 1);
+}
+
+// Overwrites the ray marched image with the per pixel statistics of the
+// MARCH_STATS variant. Rays that ran out of iterations are magenta whatever
+// the mode, they are both the most expensive and the ones that are wrong.
+void main()
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(pixel, ivec2(resolution)))) {
+		return;
+	}
+
+	uvec2 stats = imageLoad(marchStats, pixel).rg;
+	uint steps = stats.r & 0x3FFFFFFFu;
+	uint termination = stats.r >> 30;
+
+	float value = float(mode == 2 ? stats.g : steps) / float(maxIterations);
+	vec3 color = termination == 2u ? vec3(1, 0, 1) : heat(value);
+	imageStore(image, pixel, vec4(color, 1));
+}
@@ -0,0 +1,151 @@
+// World space hash grid of the light visibility and ambient occlusion that
+// shading.glsl traces, see LightCache.h. A cell is keyed by its quantized
+// position, level of detail and rough normal, and sums the samples traced from
+// the pixels that fall in it; once it has LIGHT_CACHE_MIN_SAMPLES the pixels
+// read the average instead of tracing, and keep adding a sample now and then
+// until it holds LIGHT_CACHE_MAX_SAMPLES.
+
+// Slots looked at from the hashed one before the cell goes uncached
+#define LIGHT_CACHE_PROBES 8
+// Cells are at least this many pixels across, doubling in size with distance
+#define LIGHT_CACHE_PIXELS 4
+#define LIGHT_CACHE_MIN_SAMPLES 4
+#define LIGHT_CACHE_MAX_SAMPLES 64
+// A pixel on a ready cell traces another sample with a chance of one in this
+#define LIGHT_CACHE_REFRESH 16
+// Frames a cell has to go unused before it can be evicted
+#define LIGHT_CACHE_MIN_AGE 4
+// Fixed point scale of the sums, atomics have no floats
+#define LIGHT_CACHE_SCALE 1024.0
+// Checksum of a slot that is being claimed; 0 is an empty slot
+#define LIGHT_CACHE_BUSY 0xFFFFFFFFu
+
+struct LightCacheCell {
+	uint checksum;
+	uint lastUsed;
+	uint created;
+	uint samples;
+	uint sums[4];
+};
+
+layout (std430, binding = 5) coherent buffer LightCache {
+	LightCacheCell cells[];
+};
+
+uint pcgHash(uint v)
+{
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// In [0, 1)
+float hashToFloat(uint hash)
+{
+	return float(hash >> 8) / 16777216.0;
+}
+
+// Hash of the cell that p, at distance dist along a primary ray, falls in. random
+// offsets the grid by up to a cell so that cell edges dither instead of stepping.
+uint lightCacheKey(vec3 p, vec3 normal, float dist, uint random)
+{
+	float pixelSize = 2 * invProjection[1][1] / resolution.y * dist;
+	int level = max(0, int(ceil(log2(LIGHT_CACHE_PIXELS * pixelSize / lightCacheCell))));
+	float size = lightCacheCell * exp2(float(level));
+
+	vec3 offset = vec3(hashToFloat(random), hashToFloat(pcgHash(random)), hashToFloat(pcgHash(random + 1u)));
+	ivec3 cell = ivec3(floor(p / size + offset));
+	// One of 27 directions, keeps the two sides of a thin wall apart
+	uvec3 direction = uvec3(round(normal) + 1);
+	uint normalIndex = direction.x + 3u * direction.y + 9u * direction.z;
+
+	return pcgHash(uint(level) + pcgHash(normalIndex + pcgHash(uint(cell.x) + pcgHash(uint(cell.y) + pcgHash(uint(cell.z))))));
+}
+
+// Never 0 or LIGHT_CACHE_BUSY
+uint lightCacheChecksum(uint key)
+{
+	return clamp(key, 1u, LIGHT_CACHE_BUSY - 1u);
+}
+
+// Slot of the cell for key: probes from the hashed slot for the cell, else
+// claims the first empty slot or the least recently used one that has been
+// unused for LIGHT_CACHE_MIN_AGE frames. -1 if all of them are in use or being
+// claimed. A claim first swaps in LIGHT_CACHE_BUSY, so no one matches the slot
+// while it still holds the evicted cell; the key is published only once the
+// slot is cleared.
+int lightCacheSlot(uint key)
+{
+	uint checksum = lightCacheChecksum(key);
+	int victim = -1;
+	uint victimChecksum = 0;
+	uint victimAge = LIGHT_CACHE_MIN_AGE - 1;
+	for (uint i = 0; i < LIGHT_CACHE_PROBES; i++) {
+		uint slot = (key + i) & lightCacheMask;
+		uint stored = cells[slot].checksum;
+		if (stored == checksum) {
+			cells[slot].lastUsed = lightCacheFrame;
+			return int(slot);
+		}
+		if (stored == LIGHT_CACHE_BUSY) {
+			continue;
+		}
+
+		uint age = stored == 0 ? 0xFFFFFFFFu : lightCacheFrame - cells[slot].lastUsed;
+		if (age > victimAge) {
+			victim = int(slot);
+			victimChecksum = stored;
+			victimAge = age;
+		}
+	}
+	if (victim < 0 || atomicCompSwap(cells[victim].checksum, victimChecksum, LIGHT_CACHE_BUSY) != victimChecksum) {
+		return -1;
+	}
+
+	cells[victim].lastUsed = lightCacheFrame;
+	cells[victim].created = lightCacheFrame;
+	cells[victim].samples = 0;
+	for (int i = 0; i < 4; i++) {
+		cells[victim].sums[i] = 0;
+	}
+	memoryBarrierBuffer();
+	atomicExchange(cells[victim].checksum, checksum);
+	return victim;
+}
+
+// The average of the cell, false until it has enough samples. A cell is read
+// only from the frame after its claim, once the pixels filling it are done.
+bool lightCacheRead(int slot, out vec4 lighting)
+{
+	uint samples = cells[slot].samples;
+	if (samples < LIGHT_CACHE_MIN_SAMPLES || cells[slot].created == lightCacheFrame) {
+		lighting = vec4(0);
+		return false;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		lighting[i] = float(cells[slot].sums[i]) / (LIGHT_CACHE_SCALE * float(samples));
+	}
+	return true;
+}
+
+bool lightCacheFull(int slot)
+{
+	return cells[slot].samples >= LIGHT_CACHE_MAX_SAMPLES;
+}
+
+// Dropped if the slot has been evicted since it was looked up for key. An
+// eviction between the check and the atomics still lands this sample in the new
+// cell; it takes a cell idle for LIGHT_CACHE_MIN_AGE frames being evicted in the
+// same instant a pixel looks it up again, and the new cell is unread until the
+// next frame, by which its other samples outweigh the stray one.
+void lightCacheAdd(int slot, uint key, vec4 lighting)
+{
+	if (cells[slot].checksum != lightCacheChecksum(key)) {
+		return;
+	}
+	for (int i = 0; i < 4; i++) {
+		atomicAdd(cells[slot].sums[i], uint(clamp(lighting[i], 0, 1) * LIGHT_CACHE_SCALE + 0.5));
+	}
+	atomicAdd(cells[slot].samples, 1u);
+}
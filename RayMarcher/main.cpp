@@ -3,11 +3,37 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <chrono>
 #include <iomanip>
+#include <sstream>
+#include <filesystem>
 
 #include "Shader.h"
 #include "ComputeShader.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "Accumulation.h"
+#include "BrickMap.h"
+#include "ConePrepass.h"
+#include "CpuRayMarcher.h"
+#include "DistanceVolume.h"
+#include "FrameParams.h"
+#include "FrameStats.h"
+#include "GpuProfiler.h"
+#include "LightCache.h"
+#include "ImageWriter.h"
+#include "MarchStats.h"
+#include "Options.h"
+#include "QualityGovernor.h"
+#include "RenderTargetPool.h"
+#include "Reprojection.h"
+#include "Scene.h"
+#include "SceneBuffer.h"
+#include "SceneVariants.h"
+#include "Shading.h"
+#include "Trace.h"
+#include "UniformRing.h"
+#include "WorkgroupTuner.h"
 
 constexpr auto PI = 3.1415926535f;
 
@@ -23,11 +49,35 @@ double lastTime = 0.0;
 const float speed = 5.0f;
 const float sensitivity = 0.0008f;
 bool cursorHidden = true;
+bool cpuBackend = false;
+bool reloadScene = false;
+bool volumeEnabled = true;
+bool coneEnabled = true;
+bool reprojectionEnabled = true;
+bool relaxedEnabled = false;
+bool lightCacheEnabled = true;
+MarchStats::Heatmap heatmap = MarchStats::HEATMAP_OFF;
+// Where the shaders and the default scene are, see ShaderDirectory
+std::string shaderDir;
 glm::vec2 mousePos(WINDOW_WIDTH/2, WINDOW_HEIGHT/2);
 
 GLFWwindow* Initialize(int width, int height, const char* title, int vsync);
+int RunHeadless(const Options& options);
+int RunBenchmark(const Options& options);
+std::string ShaderDirectory(const Options& options, const char* executable);
+std::string ShaderPath(const char* name);
+std::string ScenePath(const Options& options);
+void WriteTrace(const Options& options);
+void WriteMarchStats(const MarchStats& marchStats, const std::string& path);
 void SetupBuffers(GLuint& VAO);
-void SetupTexture(GLuint width, GLuint height, GLuint& texture);
+void SetupStatsBuffer(GLuint& buffer);
+GLuint ReadStatsBuffer(GLuint buffer);
+std::string RayMarchDefines(UniformRing<FrameParams>& frameRing, const FrameParams& params, const ImageFormat& format, bool retune);
+void DispatchCompute(ComputeShader& computeShader, ComputeShader& shadingShader, UniformRing<FrameParams>& frameRing, const FrameParams& params, ConePrepass* cone = nullptr,
+	Reprojection* reprojection = nullptr, GpuProfiler* profiler = nullptr);
+void WriteGpuProfile(const GpuProfiler& profiler, const std::string& path);
+void DrawQuad(Shader& shader, GLuint VAO, GLuint texture, glm::vec2 uvScale = glm::vec2(1.0f));
+void ReadImage(GLuint texture, GLuint width, GLuint height, std::vector<float>& pixels);
 void GetComputeGroupInfo();
 void KeyBoardInput();
 void MouseMoveCallback(GLFWwindow* window, double xpos, double ypos);
@@ -51,57 +101,599 @@ void printMat4(const glm::mat4& m)
 	std::cout << "\n";
 }
 
-void main()
+int main(int argc, char** argv)
 {
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		return 1;
+	}
+	if (!FindImageFormat(options.format)) {
+		std::cout << "Unknown image format " << options.format << std::endl;
+		return 1;
+	}
+	IdleMode idleMode;
+	if (!ParseIdleMode(options.idle, idleMode)) {
+		std::cout << "Unknown idle mode " << options.idle << std::endl;
+		return 1;
+	}
+	shaderDir = ShaderDirectory(options, argv[0]);
+	if (!options.trace.empty()) {
+		Trace::start();
+		Trace::setThreadName("main");
+	}
+	if (!options.benchmark.empty()) {
+		int status = RunBenchmark(options);
+		WriteTrace(options);
+		return status;
+	}
+	if (options.headless) {
+		int status = RunHeadless(options);
+		WriteTrace(options);
+		return status;
+	}
+
+	Scene scene;
+	if (!scene.load(ScenePath(options))) {
+		return 1;
+	}
+
 	window = Initialize(WINDOW_WIDTH, WINDOW_HEIGHT, "RayMarcher", 1);
 
-	Shader shader("C:/Users/jonat/source/repos/RayMarcher/RayMarcher/vertex.glsl", "C:/Users/jonat/source/repos/RayMarcher/RayMarcher/fragment.glsl");
-	ComputeShader computeShader("C:/Users/jonat/source/repos/RayMarcher/RayMarcher/compute.glsl");
+	glm::mat4 projection = glm::perspective(PI / 2, float(WINDOW_WIDTH) / WINDOW_HEIGHT, 0.01f, 10000.0f);
+	glm::mat4 invProjection = glm::inverse(projection);
 
 	GLuint QuadVAO;
 	SetupBuffers(QuadVAO);
 
 	GLuint texWidth = WINDOW_WIDTH, texHeight = WINDOW_HEIGHT;
-	GLuint texture;
-	SetupTexture(texWidth, texHeight, texture);
+	const ImageFormat& format = *FindImageFormat(options.format);
+	RenderTargetPool targets(texWidth, texHeight);
+	int output = targets.add(format.internalFormat, 0);
+
+	GLuint statsBuffer;
+	SetupStatsBuffer(statsBuffer);
+
+	SceneBuffer sceneBuffer(2, 3);
+	sceneBuffer.upload(scene);
+
+	DistanceVolume volume(1);
+	if (options.volume) {
+		volume.build(scene, options.volume);
+	}
+
+	BrickMap brickMap(2, 3);
+	if (options.bricks) {
+		brickMap.build(scene, options.bricks, (size_t)options.brickBudget << 20);
+	}
 
 	GetComputeGroupInfo();
+
+	camera = Camera(glm::vec3(0.0f, 0.0f, -10.0f));
+
+	UniformRing<FrameParams> frameRing(0);
+	FrameParams params;
+	params.cameraToWorld = glm::inverse(camera.GetViewMatrix());
+	params.invProjection = invProjection;
+	params.resolution = glm::vec2(texWidth, texHeight);
+	params.footprint = options.footprint;
+	params.shadowIterations = options.shadowIterations;
+	params.shadowSoftness = options.shadowSoftness;
+
+	Shader shader(ShaderPath("vertex.glsl").c_str(), ShaderPath("fragment.glsl").c_str());
+	std::string defines = RayMarchDefines(frameRing, params, format, options.retune);
+	SceneVariants variants(ShaderPath("compute.glsl").c_str(), defines);
+	ComputeShader* computeShader = &variants.get(scene, !options.dynamicScene);
+	// The instrumented variant, compiled on first use
+	SceneVariants statsVariants(ShaderPath("compute.glsl").c_str(), defines + MarchStats::defines());
+	ComputeShader* statsShader = nullptr;
+	Shading shading(ShaderPath("shading.glsl").c_str(), defines);
+	shading.setScene(scene, !options.dynamicScene);
+	LightCache lightCache(options.lightCache, options.lightCacheCell, 5);
+	ConePrepass conePrepass(ShaderPath("cone.glsl").c_str(), targets, 1);
+	conePrepass.setScene(scene, !options.dynamicScene);
+	coneEnabled = options.cone;
+	Reprojection reprojection(ShaderPath("reproject.glsl").c_str(), targets, 2, 3);
+	MarchStats marchStats(ShaderPath("heatmap.glsl").c_str(), defines, targets, 4, 4);
+	Accumulation accumulation(idleMode, targets, 5);
+	reprojectionEnabled = options.reprojection;
+	relaxedEnabled = options.relaxed;
+	ProgramCache::printStats();
+
+	QualityGovernor governor(options.frameBudget, texWidth, texHeight);
+	const int maxIterations = params.maxIterations;
+	const float epsilon = params.epsilon;
+
 	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-	glm::mat4 projection = glm::perspective(PI / 2, float(WINDOW_WIDTH) / WINDOW_HEIGHT, 0.01f, 10000.0f);
-	glm::mat4 invProjection = glm::inverse(projection);
+	CpuRayMarcher cpuRayMarcher(texWidth, texHeight);
+	cpuRayMarcher.setScene(scene);
+	cpuRayMarcher.setFootprint(options.footprint);
+	cpuRayMarcher.setShadows(options.shadowIterations, options.shadowSoftness);
+	double statsTime = 0.0;
+	double marchStatsTime = 0.0;
+	GpuProfiler profiler;
 
-	camera = Camera(glm::vec3(0.0f, 0.0f, -10.0f));
+	CameraPath recordedPath;
+	double startTime = glfwGetTime();
 
 	while (!glfwWindowShouldClose(window))
 	{
+		PROFILE_SCOPE("frame");
 		double currentTime = glfwGetTime();
 		dTime = currentTime - lastTime;
 		lastTime = currentTime;
 
 		KeyBoardInput();
+		profiler.beginFrame();
 
-		computeShader.use();
-		computeShader.setMat4("cameraToWorld", glm::inverse(camera.GetViewMatrix()));
-		computeShader.setMat4("invProjection", invProjection);
-		computeShader.dispatch(texWidth, texHeight, 1);
+		if (!options.record.empty()) {
+			recordedPath.record(float(currentTime - startTime), camera);
+		}
 
-		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		targets.resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+		if (targets.update()) {
+			PROFILE_SCOPE("resize");
+			texWidth = targets.width();
+			texHeight = targets.height();
+			invProjection = glm::inverse(glm::perspective(PI / 2, float(texWidth) / texHeight, 0.01f, 10000.0f));
+			params.invProjection = invProjection;
+			params.resolution = glm::vec2(texWidth, texHeight);
+			governor.resize(texWidth, texHeight);
+			reprojection.invalidate();
+			accumulation.invalidate();
+			cpuRayMarcher.resize(texWidth, texHeight);
+		}
 
-		shader.use();
+		if (reloadScene) {
+			PROFILE_SCOPE("reload scene");
+			reloadScene = false;
+
+			Scene reloaded;
+			if (reloaded.load(ScenePath(options))) {
+				scene = reloaded;
+				sceneBuffer.upload(scene);
+				cpuRayMarcher.setScene(scene);
+				computeShader = &variants.get(scene, !options.dynamicScene);
+				statsShader = nullptr;
+				shading.setScene(scene, !options.dynamicScene);
+				lightCache.invalidate();
+				conePrepass.setScene(scene, !options.dynamicScene);
+				reprojection.invalidate();
+				accumulation.invalidate();
+				if (options.volume) {
+					volume.build(scene, options.volume);
+				}
+				if (options.bricks) {
+					brickMap.build(scene, options.bricks, (size_t)options.brickBudget << 20);
+				}
+				std::cout << "Scene: " << scene.ops().size() << " ops, " << scene.bvhNodes().size() << " BVH nodes from " << ScenePath(options) << std::endl;
+			}
+		}
 
-		glBindVertexArray(QuadVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+		if (cpuBackend) {
+			cpuRayMarcher.render(glm::inverse(camera.GetViewMatrix()), invProjection);
+			reprojection.invalidate();
+			accumulation.invalidate();
+
+			profiler.begin("upload");
+			glBindTexture(GL_TEXTURE_2D, targets.texture(output));
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, GL_RGBA, GL_FLOAT, cpuRayMarcher.data());
+			profiler.end();
+
+			if (currentTime - statsTime > 1.0) {
+				statsTime = currentTime;
+				std::cout << "CPU: " << std::fixed << std::setprecision(2) << cpuRayMarcher.frameSeconds() * 1000.0 << " ms, "
+					<< cpuRayMarcher.raysPerSecond() / 1e6 << " Mrays/s on " << cpuRayMarcher.threadCount() << " threads ("
+					<< SimdIsaName(cpuRayMarcher.isa()) << ")" << std::endl;
+			}
+		}
+		else {
+			bool instrumented = heatmap != MarchStats::HEATMAP_OFF || !options.marchStats.empty();
+			bool render;
+			{
+				PROFILE_SCOPE("uniforms");
+				params.cameraToWorld = glm::inverse(camera.GetViewMatrix());
+				params.time = float(currentTime);
+				volume.apply(params, volumeEnabled);
+				brickMap.apply(params, volumeEnabled);
+				params.useCone = coneEnabled ? 1 : 0;
+				params.relaxation = relaxedEnabled ? options.relaxation : 1.0f;
+				lightCache.apply(params, lightCacheEnabled);
+				if (options.frameBudget > 0.0f && governor.apply(params, maxIterations, epsilon)) {
+					reprojection.invalidate();
+				}
+				// The heatmap replaces the image every frame, nothing to keep or average
+				render = accumulation.apply(params, !instrumented);
+				if (render) {
+					reprojection.beginFrame(params, reprojectionEnabled);
+				}
+			}
+
+			if (render) {
+				if (instrumented && !statsShader) {
+					statsShader = &statsVariants.get(scene, !options.dynamicScene);
+				}
+				if (instrumented) {
+					marchStats.beginFrame();
+				}
+
+				bool governed = options.frameBudget > 0.0f;
+				if (governed) {
+					governor.beginFrame();
+				}
+				DispatchCompute(instrumented ? *statsShader : *computeShader, shading.program(scene, instrumented), frameRing, params, &conePrepass, &reprojection,
+					&profiler);
+				if (governed) {
+					governor.endFrame();
+				}
+
+				if (instrumented) {
+					marchStats.endFrame(params.maxIterations);
+					marchStats.drawHeatmap(heatmap, (GLuint)params.resolution.x, (GLuint)params.resolution.y);
+
+					if (currentTime - marchStatsTime > 1.0) {
+						marchStatsTime = currentTime;
+						std::cout << "March: " << MarchStats::summary(marchStats.latest()) << std::endl;
+					}
+				}
+			}
+
+			if (currentTime - statsTime > 0.5) {
+				statsTime = currentTime;
+				glfwSetWindowTitle(window, ("RayMarcher | " + profiler.summary()).c_str());
+			}
+		}
 
-		glfwPollEvents();
+		profiler.begin("blit");
+		DrawQuad(shader, QuadVAO, targets.texture(output), cpuBackend || options.frameBudget <= 0.0f ? glm::vec2(1.0f) : governor.uvScale());
+		profiler.end();
+		profiler.endFrame();
 
-		glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("poll events");
+			glfwPollEvents();
+		}
+		{
+			PROFILE_SCOPE("swap buffers");
+			glfwSwapBuffers(window);
+		}
+	}
+
+	profiler.flush();
+	if (!options.gpuProfile.empty()) {
+		WriteGpuProfile(profiler, options.gpuProfile);
+	}
+	if (!options.marchStats.empty()) {
+		marchStats.flush();
+		WriteMarchStats(marchStats, options.marchStats);
+	}
+	WriteTrace(options);
+
+	if (!options.record.empty()) {
+		if (recordedPath.save(options.record)) {
+			std::cout << "Recorded " << recordedPath.size() << " camera keys to " << options.record << std::endl;
+		}
+		else {
+			std::cout << "Failed to write camera path " << options.record << std::endl;
+		}
 	}
 
 	glfwTerminate();
+	return 0;
+}
+
+// Replays a recorded camera path one key per frame, with vsync off and no input,
+// on the GPU (or the CPU backend with --headless) and reports frame statistics
+int RunBenchmark(const Options& options)
+{
+	CameraPath path;
+	if (!path.load(options.benchmark)) {
+		std::cout << "No camera keys in " << options.benchmark << std::endl;
+		return 1;
+	}
+
+	Scene scene;
+	if (!scene.load(ScenePath(options))) {
+		return 1;
+	}
+
+	glm::mat4 projection = glm::perspective(PI / 2, float(options.width) / options.height, 0.01f, 10000.0f);
+	glm::mat4 invProjection = glm::inverse(projection);
+
+	FrameStats stats;
+	std::vector<std::string> info;
+	info.push_back("\"path\": " + JsonString(options.benchmark));
+	info.push_back("\"width\": " + std::to_string(options.width));
+	info.push_back("\"height\": " + std::to_string(options.height));
+	info.push_back("\"scene\": " + JsonString(ScenePath(options)));
+	info.push_back("\"scene_ops\": " + std::to_string(scene.ops().size()));
+	info.push_back("\"scene_bvh_nodes\": " + std::to_string(scene.bvhNodes().size()));
+	info.push_back("\"footprint\": " + std::to_string(options.footprint));
+	info.push_back("\"shadow_iterations\": " + std::to_string(options.shadowIterations));
+
+	if (options.headless) {
+		unsigned threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+		CpuRayMarcher cpuRayMarcher(options.width, options.height, threads);
+		cpuRayMarcher.setScene(scene);
+		cpuRayMarcher.setFootprint(options.footprint);
+		cpuRayMarcher.setShadows(options.shadowIterations, options.shadowSoftness);
+
+		info.push_back("\"backend\": \"cpu\"");
+		info.push_back("\"threads\": " + std::to_string(cpuRayMarcher.threadCount()));
+		info.push_back("\"isa\": " + JsonString(SimdIsaName(cpuRayMarcher.isa())));
+
+		for (unsigned i = 0; i < options.warmup + path.size(); i++) {
+			Camera pathCamera = CameraPath::toCamera(path[i < options.warmup ? 0 : i - options.warmup]);
+			cpuRayMarcher.render(glm::inverse(pathCamera.GetViewMatrix()), invProjection);
+
+			if (i >= options.warmup) {
+				stats.add(cpuRayMarcher.frameSeconds(), cpuRayMarcher.frameRays(), cpuRayMarcher.frameSteps());
+			}
+		}
+	}
+	else {
+		WINDOW_WIDTH = options.width;
+		WINDOW_HEIGHT = options.height;
+		window = Initialize(WINDOW_WIDTH, WINDOW_HEIGHT, "RayMarcher benchmark", 0);
+
+		GLuint QuadVAO;
+		SetupBuffers(QuadVAO);
+
+		const ImageFormat& format = *FindImageFormat(options.format);
+		RenderTargetPool targets(options.width, options.height);
+		int output = targets.add(format.internalFormat, 0);
+
+		GLuint statsBuffer;
+		SetupStatsBuffer(statsBuffer);
+
+		SceneBuffer sceneBuffer(2, 3);
+		sceneBuffer.upload(scene);
+
+		DistanceVolume volume(1);
+		bool useVolume = options.volume && volume.build(scene, options.volume);
+
+		BrickMap brickMap(2, 3);
+		bool useBricks = options.bricks && brickMap.build(scene, options.bricks, (size_t)options.brickBudget << 20);
+
+		UniformRing<FrameParams> frameRing(0);
+		FrameParams params;
+		params.cameraToWorld = glm::inverse(CameraPath::toCamera(path[0]).GetViewMatrix());
+		params.invProjection = invProjection;
+		params.resolution = glm::vec2(options.width, options.height);
+		params.countSteps = 1;
+		params.footprint = options.footprint;
+		params.shadowIterations = options.shadowIterations;
+		params.shadowSoftness = options.shadowSoftness;
+
+		Shader shader(ShaderPath("vertex.glsl").c_str(), ShaderPath("fragment.glsl").c_str());
+		std::string defines = RayMarchDefines(frameRing, params, format, options.retune);
+		SceneVariants variants(ShaderPath("compute.glsl").c_str(), defines);
+		ComputeShader& computeShader = variants.get(scene, !options.dynamicScene);
+		// With --march-stats the measured frames run the instrumented variant
+		bool instrumented = !options.marchStats.empty();
+		SceneVariants statsVariants(ShaderPath("compute.glsl").c_str(), defines + MarchStats::defines());
+		ComputeShader& marchShader = instrumented ? statsVariants.get(scene, !options.dynamicScene) : computeShader;
+		Shading shading(ShaderPath("shading.glsl").c_str(), defines);
+		shading.setScene(scene, !options.dynamicScene);
+		LightCache lightCache(options.lightCache, options.lightCacheCell, 5);
+		ConePrepass conePrepass(ShaderPath("cone.glsl").c_str(), targets, 1);
+		conePrepass.setScene(scene, !options.dynamicScene);
+		params.useCone = options.cone ? 1 : 0;
+		params.relaxation = options.relaxed ? options.relaxation : 1.0f;
+		Reprojection reprojection(ShaderPath("reproject.glsl").c_str(), targets, 2, 3);
+		MarchStats marchStats(ShaderPath("heatmap.glsl").c_str(), defines, targets, 4, 4);
+		GpuProfiler profiler;
+		ProgramCache::printStats();
+
+		info.push_back("\"backend\": \"gpu\"");
+		info.push_back(std::string("\"scene_compiled\": ") + (!options.dynamicScene && SceneCompiler::compilable(scene.ops()) ? "true" : "false"));
+		info.push_back("\"volume\": " + std::to_string(useVolume ? options.volume : 0));
+		info.push_back("\"bricks\": " + std::to_string(useBricks ? brickMap.brickCount() : 0));
+		info.push_back(std::string("\"cone\": ") + (options.cone ? "true" : "false"));
+		info.push_back(std::string("\"reprojection\": ") + (options.reprojection ? "true" : "false"));
+		info.push_back("\"relaxation\": " + std::to_string(params.relaxation));
+		info.push_back("\"format\": " + JsonString(format.name));
+		info.push_back("\"light_cache_cells\": " + std::to_string(lightCache.cells()));
+		info.push_back(std::string("\"march_stats_variant\": ") + (instrumented ? "true" : "false"));
+		info.push_back("\"renderer\": " + JsonString((const char*)glGetString(GL_RENDERER)));
+
+		std::vector<float> measured, reference;
+		for (unsigned i = 0; i < options.warmup + path.size() && !glfwWindowShouldClose(window); i++) {
+			PROFILE_SCOPE("frame");
+			Camera pathCamera = CameraPath::toCamera(path[i < options.warmup ? 0 : i - options.warmup]);
+
+			GLuint zero = 0;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			if (i >= options.warmup) {
+				profiler.beginFrame();
+			}
+
+			params.cameraToWorld = glm::inverse(pathCamera.GetViewMatrix());
+			params.time = path[i < options.warmup ? 0 : i - options.warmup].time;
+			volume.apply(params, useVolume);
+			brickMap.apply(params, useBricks);
+			lightCache.apply(params, true);
+			reprojection.beginFrame(params, options.reprojection);
+			if (instrumented && i >= options.warmup) {
+				marchStats.beginFrame();
+			}
+			DispatchCompute(marchShader, shading.program(scene, instrumented), frameRing, params, &conePrepass, &reprojection, &profiler);
+			if (instrumented && i >= options.warmup) {
+				marchStats.endFrame(params.maxIterations);
+			}
+			profiler.begin("blit");
+			DrawQuad(shader, QuadVAO, targets.texture(output));
+			profiler.end();
+			profiler.endFrame();
+			{
+				PROFILE_SCOPE("swap buffers");
+				glfwSwapBuffers(window);
+				glFinish();
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			GLuint steps = ReadStatsBuffer(statsBuffer);
+
+			if (i >= options.warmup) {
+				stats.add(std::chrono::duration<double>(end - start).count(), (uint64_t)options.width * options.height, steps);
+			}
+
+			// Untimed: the same frame with plain sphere tracing from the cone start and
+			// every pixel's lighting traced
+			if (options.comparePlain && i >= options.warmup) {
+				PROFILE_SCOPE("compare plain");
+				ReadImage(targets.texture(output), options.width, options.height, measured);
+
+				FrameParams plain = params;
+				plain.relaxation = 1.0f;
+				plain.useReprojection = 0;
+				plain.useLightCache = 0;
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+				// The next timed frame warm starts from this frame's depth, not the plain pass's
+				reprojection.saveHistory();
+				DispatchCompute(computeShader, shading.program(scene, false), frameRing, plain, &conePrepass);
+				ReadImage(targets.texture(output), options.width, options.height, reference);
+				reprojection.restoreHistory();
+
+				GLuint referenceSteps = ReadStatsBuffer(statsBuffer);
+
+				double squaredError = 0.0;
+				for (size_t k = 0; k < measured.size(); k++) {
+					if (k % 4 == 3) continue;
+					double difference = measured[k] - reference[k];
+					squaredError += difference * difference;
+				}
+				stats.addReference((uint64_t)options.width * options.height, referenceSteps, squaredError, measured.size() / 4 * 3);
+			}
+
+			glfwPollEvents();
+		}
+
+		profiler.flush();
+		info.push_back(profiler.json());
+		if (instrumented) {
+			marchStats.flush();
+			info.push_back(MarchStats::json(marchStats.total()));
+			WriteMarchStats(marchStats, options.marchStats);
+		}
+		if (!options.gpuProfile.empty()) {
+			WriteGpuProfile(profiler, options.gpuProfile);
+		}
+
+		glfwTerminate();
+	}
+
+	stats.print(std::cout);
+
+	if (!options.json.empty()) {
+		if (!stats.writeJson(options.json, info)) {
+			std::cout << "Failed to write " << options.json << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << options.json << std::endl;
+	}
+	return 0;
+}
+
+int RunHeadless(const Options& options)
+{
+	Scene scene;
+	if (!scene.load(ScenePath(options))) {
+		return 1;
+	}
+
+	Camera headlessCamera(options.position, glm::vec3(0.0f, 1.0f, 0.0f), options.yaw, options.pitch);
+	glm::mat4 cameraToWorld = glm::inverse(headlessCamera.GetViewMatrix());
+	glm::mat4 projection = glm::perspective(PI / 2, float(options.width) / options.height, 0.01f, 10000.0f);
+	glm::mat4 invProjection = glm::inverse(projection);
+
+	unsigned threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+	CpuRayMarcher cpuRayMarcher(options.width, options.height, threads);
+	cpuRayMarcher.setScene(scene);
+	cpuRayMarcher.setFootprint(options.footprint);
+	cpuRayMarcher.setShadows(options.shadowIterations, options.shadowSoftness);
+
+	std::cout << "Headless: " << options.width << "x" << options.height << ", " << options.frames << " frames, "
+		<< cpuRayMarcher.threadCount() << " threads (" << SimdIsaName(cpuRayMarcher.isa()) << ")" << std::endl;
+
+	double totalSeconds = 0.0;
+	for (unsigned frame = 0; frame < options.frames; frame++) {
+		cpuRayMarcher.render(cameraToWorld, invProjection);
+		totalSeconds += cpuRayMarcher.frameSeconds();
+
+		PROFILE_SCOPE("write image");
+		std::ostringstream path;
+		path << options.output << "_" << std::setw(4) << std::setfill('0') << frame << ".ppm";
+		if (!WritePPM(path.str(), options.width, options.height, cpuRayMarcher.data())) {
+			std::cout << "Failed to write " << path.str() << std::endl;
+			return 1;
+		}
+
+		std::cout << "Frame " << frame << ": " << std::fixed << std::setprecision(2) << cpuRayMarcher.frameSeconds() * 1000.0 << " ms, "
+			<< cpuRayMarcher.raysPerSecond() / 1e6 << " Mrays/s, " << path.str() << std::endl;
+	}
+
+	if (options.frames > 0) {
+		std::cout << "Average: " << std::fixed << std::setprecision(2) << totalSeconds * 1000.0 / options.frames << " ms/frame" << std::endl;
+	}
+	return 0;
+}
+
+// --shader-dir, else the SHADER_DIR the build defines, else the executable's directory
+std::string ShaderDirectory(const Options& options, const char* executable)
+{
+	std::string dir = options.shaderDir;
+#ifdef SHADER_DIR
+	if (dir.empty()) {
+		dir = SHADER_DIR;
+	}
+#endif
+	if (dir.empty()) {
+		dir = std::filesystem::path(executable).parent_path().string();
+	}
+	if (!dir.empty() && dir.back() != '/' && dir.back() != '\\') {
+		dir += '/';
+	}
+	return dir;
+}
+
+std::string ShaderPath(const char* name)
+{
+	return shaderDir + name;
+}
+
+std::string ScenePath(const Options& options)
+{
+	return options.scene.empty() ? ShaderPath("scene.txt") : options.scene;
+}
+
+void WriteMarchStats(const MarchStats& marchStats, const std::string& path)
+{
+	std::cout << "March over all frames: " << MarchStats::summary(marchStats.total()) << std::endl;
+	if (MarchStats::writeHistogram(path, marchStats.total(), marchStats.maxIterations())) {
+		std::cout << "Wrote " << path << std::endl;
+	}
+	else {
+		std::cout << "Failed to write " << path << std::endl;
+	}
+}
+
+void WriteTrace(const Options& options)
+{
+	if (options.trace.empty()) return;
+
+	if (Trace::write(options.trace)) {
+		std::cout << "Wrote " << options.trace << std::endl;
+	}
+	else {
+		std::cout << "Failed to write " << options.trace << std::endl;
+	}
 }
 
 glm::vec3 erot(glm::vec3 p, glm::vec3 ax, float ro)
@@ -135,6 +727,7 @@ GLFWwindow* Initialize(int width, int height, const char* title, int vsync)
 	}
 
 	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+	GpuProfiler::calibrateTrace();
 
 	return window;
 }
@@ -166,23 +759,105 @@ void SetupBuffers(GLuint& VAO)
 	glEnableVertexAttribArray(1);
 }
 
-void SetupTexture(GLuint width, GLuint height, GLuint& texture)
+void SetupStatsBuffer(GLuint& buffer)
 {
-	glGenTextures(1, &texture);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	GLuint zero = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffer);
+}
+
+// The step count of the last dispatch. Binds the buffer itself, as MarchStats and
+// others replace the generic GL_SHADER_STORAGE_BUFFER binding in between.
+GLuint ReadStatsBuffer(GLuint buffer)
+{
+	GLuint steps = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &steps);
+	return steps;
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+// Defines for compute.glsl writing the output image in format, with the fastest workgroup size for this
+// device, timing candidates on first use
+std::string RayMarchDefines(UniformRing<FrameParams>& frameRing, const FrameParams& params, const ImageFormat& format, bool retune)
+{
+	std::string defines = ShaderDefine("IMAGE_FORMAT", format.qualifier);
 
-	float* data = new float[4 * width * height];
-	memset(data, 0.0f, 4 * width * height);
+	WorkgroupTuner tuner("workgroup_size.txt");
+	WorkgroupSize size = tuner.tune(ShaderPath("compute.glsl").c_str(), defines, (GLuint)params.resolution.x, (GLuint)params.resolution.y, [&](ComputeShader&) {
+		frameRing.push(params);
+	}, retune);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, data);
+	return defines + WorkgroupTuner::defines(size);
+}
 
-	glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+// Writes the frame parameters into the next ring slot once, runs the reprojection and
+// cone prepasses if params enable them, then dispatches over the whole resolution
+void DispatchCompute(ComputeShader& computeShader, ComputeShader& shadingShader, UniformRing<FrameParams>& frameRing, const FrameParams& params, ConePrepass* cone,
+	Reprojection* reprojection, GpuProfiler* profiler)
+{
+	PROFILE_SCOPE("dispatch");
+	frameRing.push(params);
+	if (reprojection) {
+		if (profiler) profiler->begin("reproject");
+		reprojection->dispatch(params);
+		if (profiler) profiler->end();
+	}
+	if (params.useCone && cone) {
+		if (profiler) profiler->begin("cone");
+		cone->dispatch();
+		if (profiler) profiler->end();
+	}
+	if (profiler) profiler->begin("march");
+	computeShader.use();
+	computeShader.dispatchPixels((GLuint)params.resolution.x, (GLuint)params.resolution.y);
+	if (profiler) profiler->end();
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	if (profiler) profiler->begin("shading");
+	shadingShader.use();
+	shadingShader.dispatchPixels((GLuint)params.resolution.x, (GLuint)params.resolution.y);
+	if (profiler) profiler->end();
+	frameRing.fence();
+}
+
+void WriteGpuProfile(const GpuProfiler& profiler, const std::string& path)
+{
+	if (profiler.write(path)) {
+		std::cout << "Wrote " << path << std::endl;
+	}
+	else {
+		std::cout << "Failed to write " << path << std::endl;
+	}
+}
+
+// uvScale selects the top left part of the texture that was rendered to
+void DrawQuad(Shader& shader, GLuint VAO, GLuint texture, glm::vec2 uvScale)
+{
+	PROFILE_SCOPE("draw");
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	shader.use();
+	shader.setVec2("uvScale", uvScale);
+
+	glBindVertexArray(VAO);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Reads back the image written by the compute shader as RGBA floats
+void ReadImage(GLuint texture, GLuint width, GLuint height, std::vector<float>& pixels)
+{
+	pixels.resize((size_t)width * height * 4);
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels.data());
 }
 
 void GetComputeGroupInfo()
@@ -209,9 +884,97 @@ void GetComputeGroupInfo()
 
 void KeyBoardInput()
 {
+	PROFILE_SCOPE("input");
+	static bool backendKeyDown = false;
+	static bool reloadKeyDown = false;
+	static bool volumeKeyDown = false;
+	static bool coneKeyDown = false;
+	static bool reprojectionKeyDown = false;
+	static bool relaxedKeyDown = false;
+	static bool heatmapKeyDown = false;
+	static bool lightCacheKeyDown = false;
+
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) {
+		if (!backendKeyDown) {
+			cpuBackend = !cpuBackend;
+			std::cout << "Backend: " << (cpuBackend ? "CPU" : "GPU") << std::endl;
+		}
+		backendKeyDown = true;
+	}
+	else {
+		backendKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+		reloadScene = reloadScene || !reloadKeyDown;
+		reloadKeyDown = true;
+	}
+	else {
+		reloadKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
+		if (!volumeKeyDown) {
+			volumeEnabled = !volumeEnabled;
+			std::cout << "Distance volume and brick map: " << (volumeEnabled ? "on" : "off") << std::endl;
+		}
+		volumeKeyDown = true;
+	}
+	else {
+		volumeKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+		if (!coneKeyDown) {
+			coneEnabled = !coneEnabled;
+			std::cout << "Cone prepass: " << (coneEnabled ? "on" : "off") << std::endl;
+		}
+		coneKeyDown = true;
+	}
+	else {
+		coneKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+		if (!reprojectionKeyDown) {
+			reprojectionEnabled = !reprojectionEnabled;
+			std::cout << "Temporal reprojection: " << (reprojectionEnabled ? "on" : "off") << std::endl;
+		}
+		reprojectionKeyDown = true;
+	}
+	else {
+		reprojectionKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+		if (!relaxedKeyDown) {
+			relaxedEnabled = !relaxedEnabled;
+			std::cout << "Over-relaxed sphere tracing: " << (relaxedEnabled ? "on" : "off") << std::endl;
+		}
+		relaxedKeyDown = true;
+	}
+	else {
+		relaxedKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+		if (!lightCacheKeyDown) {
+			lightCacheEnabled = !lightCacheEnabled;
+			std::cout << "Light cache: " << (lightCacheEnabled ? "on" : "off") << std::endl;
+		}
+		lightCacheKeyDown = true;
+	}
+	else {
+		lightCacheKeyDown = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
+		if (!heatmapKeyDown) {
+			static const char* names[] = { "off", "steps", "SDF evaluations" };
+			heatmap = MarchStats::Heatmap((heatmap + 1) % MarchStats::HEATMAP_COUNT);
+			std::cout << "Heatmap: " << names[heatmap] << std::endl;
+		}
+		heatmapKeyDown = true;
+	}
+	else {
+		heatmapKeyDown = false;
+	}
 	if (glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_PRESS) {
 		glfwSetInputMode(window, GLFW_CURSOR, cursorHidden ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
 		cursorHidden = !cursorHidden;
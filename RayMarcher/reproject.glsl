@@ -0,0 +1,39 @@
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8) in;
+layout (binding = 2, r32f) uniform readonly image2D depth;
+layout (binding = 3, r32ui) uniform coherent uimage2D reprojected;
+
+#include "scene.glsl"
+
+// Scatters the hit points of the previous frame into the current one. Each hit
+// is rebuilt from the previous camera, projected with the current one and its
+// distance to the current camera kept with atomicMin, so where several points
+// land in one pixel the nearest wins. Distances are positive, which makes
+// their bit patterns order like the floats. Pixels nothing lands in keep the
+// cleared value and compute.glsl marches them from the start.
+void main()
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(pixel, ivec2(resolution)))) {
+		return;
+	}
+
+	float dist = imageLoad(depth, pixel).r;
+	if (dist <= 0 || dist >= MAX_DIST) {
+		return;
+	}
+
+	vec3 hit = (prevCameraToWorld * vec4(0, 0, 0, 1)).xyz + dist * pixelDirection(vec2(pixel), prevCameraToWorld);
+	vec4 clip = worldToClip * vec4(hit, 1);
+	if (clip.w <= 0) {
+		return;
+	}
+
+	ivec2 target = ivec2(round((clip.xy / clip.w + 1) * 0.5 * resolution));
+	if (any(lessThan(target, ivec2(0))) || any(greaterThanEqual(target, ivec2(resolution)))) {
+		return;
+	}
+
+	float reprojectedDist = length(hit - (cameraToWorld * vec4(0, 0, 0, 1)).xyz);
+	imageAtomicMin(reprojected, target, floatBitsToUint(reprojectedDist));
+}
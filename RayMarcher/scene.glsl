@@ -0,0 +1,394 @@
+// Shared by compute.glsl and cone.glsl: frame parameters, scene data and the
+// distance functions used for marching.
+
+#define PI 3.1415926535
+#define MAX_DIST 1000000
+
+// Scene program opcodes and stack depth, see Scene.h
+#define OP_SPHERE 0
+#define OP_BOX 1
+#define OP_UNION 2
+#define OP_INTERSECT 3
+#define OP_DIFFERENCE 4
+#define SCENE_STACK_SIZE 16
+#define SCENE_BVH_STACK_SIZE 32
+
+layout (std140, binding = 0) uniform FrameParams {
+	mat4 cameraToWorld;
+	mat4 invProjection;
+	vec2 resolution;
+	float time;
+	float epsilon;
+	int maxIterations;
+	bool countSteps;
+	bool useVolume;
+	vec3 volumeMin;
+	float volumeError;
+	vec3 volumeMax;
+	bool useBricks;
+	vec3 brickMin;
+	float brickCell;
+	bool useCone;
+	bool useReprojection;
+	float relaxation;
+	float footprint;
+	mat4 prevCameraToWorld;
+	mat4 worldToClip;
+	// Subpixel offset of every primary ray, and the samples already averaged, see Accumulation.h
+	vec2 jitter;
+	bool useAccumulation;
+	uint accumulatedFrames;
+	// Budget and penumbra scale of the shadow rays in shading.glsl, no shadows at 0 iterations
+	int shadowIterations;
+	float shadowSoftness;
+	// World space hash grid of lighting in shading.glsl, see LightCache.h
+	bool useLightCache;
+	uint lightCacheMask;
+	uint lightCacheFrame;
+	float lightCacheCell;
+};
+
+layout (binding = 1) uniform sampler3D distanceVolume;
+layout (binding = 2) uniform sampler3D brickAtlas;
+layout (binding = 3) uniform sampler3D brickIndirection;
+
+layout (std430, binding = 1) buffer MarchStats {
+	uint totalSteps;
+};
+
+// Pixels per side of a cone prepass tile, see ConePrepass.h
+#define CONE_TILE 8
+
+float intersectSDF(float distA, float distB)
+{
+	return max(distA, distB);
+}
+
+float unionSDF(float distA, float distB)
+{
+	return min(distA, distB);
+}
+
+float differenceSDF(float distA, float distB)
+{
+	return max(distA, -distB);
+}
+
+float sphereSDF(vec3 p, vec3 pos, float radius)
+{
+	p = p - pos;
+	return length(p) - radius;
+}
+
+float boxSDF(vec3 p, vec3 pos, vec3 size)
+{
+	p = p - pos;
+	vec3 q = abs(p) - size;
+	return length(max(q, 0)) + min(max(q.x, max(q.y, q.z)), 0);
+}
+
+// Distance and gradient as dual numbers: gradient in xyz, distance in w. Normals
+// come from these instead of extra sceneSDF samples, see Scene.h for the CPU side.
+vec4 sphereGradient(vec3 p, vec3 pos, float radius)
+{
+	p = p - pos;
+	float len = length(p);
+	return vec4(len > 0 ? p / len : vec3(0), len - radius);
+}
+
+vec4 boxGradient(vec3 p, vec3 pos, vec3 size)
+{
+	p = p - pos;
+	vec3 side = mix(vec3(1), vec3(-1), lessThan(p, vec3(0)));
+	vec3 q = abs(p) - size;
+	vec3 outside = max(q, 0);
+	float len = length(outside);
+	if (len > 0) {
+		return vec4(side * outside / len, len);
+	}
+
+	int axis = q.x > q.y ? (q.x > q.z ? 0 : 2) : (q.y > q.z ? 1 : 2);
+	vec3 gradient = vec3(0);
+	gradient[axis] = side[axis];
+	return vec4(gradient, q[axis]);
+}
+
+vec4 unionGradient(vec4 a, vec4 b)
+{
+	return a.w <= b.w ? a : b;
+}
+
+vec4 intersectGradient(vec4 a, vec4 b)
+{
+	return a.w >= b.w ? a : b;
+}
+
+vec4 differenceGradient(vec4 a, vec4 b)
+{
+	return a.w >= -b.w ? a : -b;
+}
+
+
+#ifdef SCENE_COMPILED
+// Replaced at load time with the straight-line sceneSDF and sceneGradient from SceneCompiler.h
+//@SCENE_SDF
+#else
+struct SceneOp {
+	vec4 params;
+	vec3 size;
+	uint type;
+};
+
+struct SceneBvhNode {
+	vec3 boundsMin;
+	uint first;
+	vec3 boundsMax;
+	uint count;
+};
+
+layout (std430, binding = 2) readonly buffer SceneBuffer {
+	uint sceneOpCount;
+	SceneOp sceneOps[];
+};
+
+layout (std430, binding = 3) readonly buffer SceneBvh {
+	uint bvhNodeCount;
+	SceneBvhNode bvhNodes[];
+};
+
+// Walks a postfix program from the scene buffer: primitives push a distance, operators combine the top two
+float evaluateOps(vec3 p, uint first, uint count)
+{
+	float stack[SCENE_STACK_SIZE];
+	int top = 0;
+	for (uint i = first; i < first + count; i++) {
+		SceneOp op = sceneOps[i];
+		switch (op.type) {
+		case OP_SPHERE:
+			stack[top++] = sphereSDF(p, op.params.xyz, op.params.w);
+			break;
+		case OP_BOX:
+			stack[top++] = boxSDF(p, op.params.xyz, op.size);
+			break;
+		case OP_UNION:
+			top--;
+			stack[top - 1] = unionSDF(stack[top - 1], stack[top]);
+			break;
+		case OP_INTERSECT:
+			top--;
+			stack[top - 1] = intersectSDF(stack[top - 1], stack[top]);
+			break;
+		case OP_DIFFERENCE:
+			top--;
+			stack[top - 1] = differenceSDF(stack[top - 1], stack[top]);
+			break;
+		}
+	}
+	return top > 0 ? stack[0] : MAX_DIST;
+}
+
+// evaluateOps on dual numbers
+vec4 evaluateOpsGradient(vec3 p, uint first, uint count)
+{
+	vec4 stack[SCENE_STACK_SIZE];
+	int top = 0;
+	for (uint i = first; i < first + count; i++) {
+		SceneOp op = sceneOps[i];
+		switch (op.type) {
+		case OP_SPHERE:
+			stack[top++] = sphereGradient(p, op.params.xyz, op.params.w);
+			break;
+		case OP_BOX:
+			stack[top++] = boxGradient(p, op.params.xyz, op.size);
+			break;
+		case OP_UNION:
+			top--;
+			stack[top - 1] = unionGradient(stack[top - 1], stack[top]);
+			break;
+		case OP_INTERSECT:
+			top--;
+			stack[top - 1] = intersectGradient(stack[top - 1], stack[top]);
+			break;
+		case OP_DIFFERENCE:
+			top--;
+			stack[top - 1] = differenceGradient(stack[top - 1], stack[top]);
+			break;
+		}
+	}
+	return top > 0 ? stack[0] : vec4(0, 0, 0, MAX_DIST);
+}
+
+float boundsDistance(vec3 p, SceneBvhNode node)
+{
+	return length(max(max(node.boundsMin - p, p - node.boundsMax), 0));
+}
+
+// Traverses the scene BVH near child first. Nodes beyond the best distance so far are
+// skipped and nodes further away than their diagonal answer with their bound distance,
+// see Scene::evaluate.
+float sceneSDF(vec3 p)
+{
+	float best = MAX_DIST;
+	if (bvhNodeCount == 0) {
+		return best;
+	}
+
+	uint stack[SCENE_BVH_STACK_SIZE];
+	float stackDist[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top] = 0;
+	stackDist[top++] = boundsDistance(p, bvhNodes[0]);
+
+	while (top > 0) {
+		top--;
+		SceneBvhNode node = bvhNodes[stack[top]];
+		float dist = stackDist[top];
+		if (dist >= best) {
+			continue;
+		}
+
+		if (dist > length(node.boundsMax - node.boundsMin)) {
+			best = dist;
+		}
+		else if (node.count > 0) {
+			best = min(best, evaluateOps(p, node.first, node.count));
+		}
+		else {
+			float left = boundsDistance(p, bvhNodes[node.first]);
+			float right = boundsDistance(p, bvhNodes[node.first + 1]);
+			bool leftFirst = left <= right;
+			stack[top] = leftFirst ? node.first + 1 : node.first;
+			stackDist[top++] = leftFirst ? right : left;
+			stack[top] = leftFirst ? node.first : node.first + 1;
+			stackDist[top++] = leftFirst ? left : right;
+		}
+	}
+	return best;
+}
+
+// sceneSDF on dual numbers. Nodes answering with their bound distance have no
+// gradient; close to a surface, where normals are taken, they never win.
+#define SCENE_GRADIENT
+vec4 sceneGradient(vec3 p)
+{
+	vec4 best = vec4(0, 0, 0, MAX_DIST);
+	if (bvhNodeCount == 0) {
+		return best;
+	}
+
+	uint stack[SCENE_BVH_STACK_SIZE];
+	float stackDist[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top] = 0;
+	stackDist[top++] = boundsDistance(p, bvhNodes[0]);
+
+	while (top > 0) {
+		top--;
+		SceneBvhNode node = bvhNodes[stack[top]];
+		float dist = stackDist[top];
+		if (dist >= best.w) {
+			continue;
+		}
+
+		if (dist > length(node.boundsMax - node.boundsMin)) {
+			best = vec4(0, 0, 0, dist);
+		}
+		else if (node.count > 0) {
+			best = unionGradient(best, evaluateOpsGradient(p, node.first, node.count));
+		}
+		else {
+			float left = boundsDistance(p, bvhNodes[node.first]);
+			float right = boundsDistance(p, bvhNodes[node.first + 1]);
+			bool leftFirst = left <= right;
+			stack[top] = leftFirst ? node.first + 1 : node.first;
+			stackDist[top++] = leftFirst ? right : left;
+			stack[top] = leftFirst ? node.first : node.first + 1;
+			stackDist[top++] = leftFirst ? left : right;
+		}
+	}
+	return best;
+}
+#endif
+
+// Half floats carry 11 significant bits
+#define HALF_EPSILON 0.0009765625
+
+// Samples per brick edge, see BrickMap.h
+#define BRICK_SIZE 8
+#define BRICK_SAMPLES 9
+
+// Lower bound from the brick map. Empty cells answer with the distance from
+// their center less the offset to it; brick cells with a trilinear sample less
+// the voxel diagonal and half float rounding, like the dense volume. Close to
+// surfaces the exact sceneSDF takes over.
+float brickSDF(vec3 p)
+{
+	ivec3 grid = textureSize(brickIndirection, 0);
+	vec3 outside = max(max(brickMin - p, p - (brickMin + brickCell * vec3(grid))), 0);
+	if (any(greaterThan(outside, vec3(0)))) {
+		return length(outside) + brickCell;
+	}
+
+	vec3 local = (p - brickMin) / brickCell;
+	ivec3 cell = min(ivec3(local), grid - 1);
+	vec2 entry = texelFetch(brickIndirection, cell, 0).rg;
+	if (entry.x < 0) {
+		float offset = length(p - brickMin - brickCell * (vec3(cell) + 0.5));
+		return entry.y > 0 ? entry.y - offset : entry.y + offset;
+	}
+
+	ivec3 bricks = textureSize(brickAtlas, 0) / BRICK_SAMPLES;
+	int brick = int(entry.x);
+	ivec3 origin = BRICK_SAMPLES * ivec3(brick % bricks.x, (brick / bricks.x) % bricks.y, brick / (bricks.x * bricks.y));
+	vec3 uvw = (vec3(origin) + 0.5 + (local - vec3(cell)) * BRICK_SIZE) / vec3(textureSize(brickAtlas, 0));
+
+	float voxelDiagonal = 1.7320508 * brickCell / BRICK_SIZE;
+	float sampled = texture(brickAtlas, uvw).r;
+	float bound = sampled - voxelDiagonal - abs(sampled) * HALF_EPSILON;
+	return bound > voxelDiagonal ? bound : sceneSDF(p);
+}
+
+// Distance used to step the march. Inside the baked volume a trilinear sample,
+// lowered by the voxel diagonal (the field is 1-Lipschitz) and the half float
+// rounding, is a safe lower bound; outside it the distance to the volume is.
+// Close to surfaces the exact sceneSDF takes over so hits and normals are exact.
+float marchSDF(vec3 p)
+{
+	if (useBricks) {
+		return brickSDF(p);
+	}
+	if (!useVolume) {
+		return sceneSDF(p);
+	}
+
+	vec3 outside = max(max(volumeMin - p, p - volumeMax), 0);
+	if (any(greaterThan(outside, vec3(0)))) {
+		return length(outside) + volumeError;
+	}
+
+	float sampled = texture(distanceVolume, (p - volumeMin) / (volumeMax - volumeMin)).r;
+	float bound = sampled - volumeError - abs(sampled) * HALF_EPSILON;
+	return bound > volumeError ? bound : sceneSDF(p);
+}
+
+// Hit tolerance at distance t along a primary ray: epsilon up close, further away
+// the radius of the pixel's footprint (times footprint), as detail below a pixel
+// can't be seen. invProjection[1][1] is tan(fovy / 2), half a pixel spans that
+// over resolution.y at unit distance.
+float hitEpsilon(float t)
+{
+	return max(epsilon, footprint * invProjection[1][1] / resolution.y * t);
+}
+
+// World space direction of the primary ray through pixel for a camera placed by toWorld
+vec3 pixelDirection(vec2 pixel, mat4 toWorld)
+{
+	vec3 direction = (invProjection * vec4(2*pixel.x/resolution.x - 1, 2*pixel.y/resolution.y - 1, 0, 1)).xyz;
+	direction = (toWorld * vec4(direction, 0)).xyz;
+	return normalize(direction);
+}
+
+vec3 pixelDirection(vec2 pixel)
+{
+	return pixelDirection(pixel, cameraToWorld);
+}
@@ -0,0 +1,196 @@
+#version 460 core
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+#ifndef IMAGE_FORMAT
+#define IMAGE_FORMAT rgba32f
+#endif
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+layout (binding = 0, IMAGE_FORMAT) uniform writeonly image2D image;
+layout (binding = 2, r32f) uniform readonly image2D depth;
+layout (binding = 5, rgba32f) uniform image2D accumulation;
+
+#include "scene.glsl"
+#include "stats.glsl"
+#include "lightcache.glsl"
+
+#ifdef MARCH_STATS
+layout (binding = 4, rg32ui) uniform uimage2D marchStats;
+#endif
+
+// Shadow rays start this many hit tolerances off the surface, clear of its own
+// hit tolerance
+#define SHADOW_BIAS 4
+// Visibility under which a light counts as fully occluded
+#define SHADOW_CUTOFF 0.01
+// Reach and sample count of the ambient occlusion along the normal
+#define AO_DISTANCE 0.5
+#define AO_SAMPLES 5
+#define AMBIENT vec3(0.06, 0.08, 0.2)
+
+#define NUM_LIGHTS 3
+const vec3 lights[NUM_LIGHTS] = vec3[](vec3(4, 10, -10), vec3(4, 10, 10), vec3(-5, 10, 10));
+
+// Four sceneSDF samples on the corners of a tetrahedron of size eps, the hit tolerance at p
+vec3 tetrahedralNormal(vec3 p, float eps)
+{
+	const vec2 k = vec2(1, -1);
+	return normalize(k.xyy * sceneSDF(p + eps * k.xyy) + k.yyx * sceneSDF(p + eps * k.yyx) +
+					 k.yxy * sceneSDF(p + eps * k.yxy) + k.xxx * sceneSDF(p + eps * k.xxx));
+}
+
+// The analytic gradient where the scene provides one (SCENE_GRADIENT), else the
+// tetrahedral estimate
+vec3 estimateNormal(vec3 p, float eps)
+{
+#ifdef SCENE_GRADIENT
+	COUNT_EVALUATIONS(1);
+	vec3 gradient = sceneGradient(p).xyz;
+	if (dot(gradient, gradient) > 0) {
+		return normalize(gradient);
+	}
+#endif
+	COUNT_EVALUATIONS(4);
+	return tetrahedralNormal(p, eps);
+}
+
+// Share of a light at lightDist along direction that p sees, in [0, 1]. Marches
+// toward the light and keeps the smallest ratio of distance to travelled length,
+// the tangent of the widest cone around the ray that stays empty; scaled by
+// shadowSoftness it is the penumbra estimate. The march gives up on its own budget
+// of shadowIterations, and stops early in shadow once the estimate drops under
+// SHADOW_CUTOFF, and lit once an empty sphere reaches the light.
+float softShadow(vec3 p, vec3 direction, float lightDist, float eps)
+{
+	float visibility = 1;
+	float t = SHADOW_BIAS * eps;
+	for (int i = 0; i < shadowIterations; i++) {
+		float dist = marchSDF(p + t * direction);
+		COUNT_EVALUATIONS(1);
+
+		visibility = min(visibility, shadowSoftness * dist / t);
+		if (visibility < SHADOW_CUTOFF) {
+			return 0;
+		}
+		if (dist >= lightDist - t) {
+			break;
+		}
+		t += max(dist, eps);
+	}
+	return smoothstep(0, 1, visibility);
+}
+
+// Share of the ambient light that reaches p: samples the distance at growing
+// heights along the normal, where an empty space as tall as the height means no
+// occlusion. Nearer samples weigh more.
+float ambientOcclusion(vec3 p, vec3 normal, float eps)
+{
+	float occlusion = 0;
+	float weight = 1;
+	float totalWeight = 0;
+	for (int i = 1; i <= AO_SAMPLES; i++) {
+		float h = SHADOW_BIAS * eps + AO_DISTANCE * i / AO_SAMPLES;
+		float dist = marchSDF(p + h * normal);
+		COUNT_EVALUATIONS(1);
+
+		occlusion += weight * clamp((h - dist) / h, 0, 1);
+		totalWeight += weight;
+		weight *= 0.5;
+	}
+	return 1 - occlusion / totalWeight;
+}
+
+// Visibility of every light in xyz, ambient occlusion in w
+vec4 traceLighting(vec3 p, vec3 normal, float eps)
+{
+	vec4 lighting = vec4(0, 0, 0, ambientOcclusion(p, normal, eps));
+	for (int i = 0; i < NUM_LIGHTS; i++) {
+		vec3 toLight = lights[i] - p;
+		float lightDist = length(toLight);
+
+		// Surfaces facing away are unlit whatever is in between
+		if (dot(toLight, normal) > 0) {
+			lighting[i] = shadowIterations > 0 ? softShadow(p, toLight / lightDist, lightDist, eps) : 1;
+		}
+	}
+	return lighting;
+}
+
+// traceLighting through the light cache: a pixel on a cell with enough samples
+// reads their average, others trace and add what they find
+vec4 cachedLighting(vec3 p, vec3 normal, float eps, float dist, ivec2 pixel)
+{
+	if (!useLightCache) {
+		return traceLighting(p, normal, eps);
+	}
+
+	uint random = pcgHash(uint(pixel.x) + pcgHash(uint(pixel.y) + pcgHash(accumulatedFrames)));
+	uint key = lightCacheKey(p, normal, dist, random);
+	int slot = lightCacheSlot(key);
+	if (slot < 0) {
+		return traceLighting(p, normal, eps);
+	}
+
+	vec4 cached;
+	bool ready = lightCacheRead(slot, cached);
+	bool refresh = !lightCacheFull(slot) && hashToFloat(pcgHash(random + 2u)) * LIGHT_CACHE_REFRESH < 1;
+	if (ready && !refresh) {
+		return cached;
+	}
+
+	vec4 traced = traceLighting(p, normal, eps);
+	if (!lightCacheFull(slot)) {
+		lightCacheAdd(slot, key, traced);
+	}
+	// A refreshing pixel still shows the average, so the cell looks the same throughout
+	return ready ? cached : traced;
+}
+
+vec4 shading(vec3 p, vec3 normal, vec4 lighting)
+{
+	vec4 color = vec4(lighting.w * AMBIENT, 0);
+	for (int i = 0; i < NUM_LIGHTS; i++) {
+		float diffuse = max(dot(normalize(lights[i] - p), normal), 0) * lighting[i];
+		color += vec4(diffuse * vec3(0.3, 0.4, 1.0), 1.0);
+	}
+	return color;
+}
+
+// Lights the hits compute.glsl left in the depth image, as a pass of its own so
+// that the shadow rays show up separately in the GPU profile. The primary ray is
+// rebuilt exactly as compute.glsl marched it.
+void main()
+{
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(pixel, ivec2(resolution)))) {
+		return;
+	}
+
+	float dist = imageLoad(depth, pixel).r;
+	vec4 color = vec4(0.7, 0.7, 0.9, 1.0);
+	if (dist != MAX_DIST) {
+		vec3 origin = (cameraToWorld * vec4(0, 0, 0, 1)).xyz;
+		vec3 p = origin + dist * pixelDirection(vec2(pixel) + jitter);
+		float eps = hitEpsilon(dist);
+		vec3 normal = estimateNormal(p, eps);
+		color = shading(p, normal, cachedLighting(p, normal, eps, dist, pixel));
+	}
+
+	if (useAccumulation) {
+		// Running average of the jittered samples so far
+		if (accumulatedFrames > 0) {
+			color = mix(imageLoad(accumulation, pixel), color, 1.0 / float(accumulatedFrames + 1));
+		}
+		imageStore(accumulation, pixel, color);
+	}
+	imageStore(image, pixel, color);
+
+#ifdef MARCH_STATS
+	uvec2 stats = imageLoad(marchStats, pixel).rg;
+	imageStore(marchStats, pixel, uvec4(stats.r, stats.g + sdfEvaluations, 0, 0));
+	atomicAdd(evaluations, sdfEvaluations);
+#endif
+}
@@ -0,0 +1,22 @@
+// Counters of the instrumented MARCH_STATS variants of compute.glsl and
+// shading.glsl, see MarchStats.h. Every invocation adds its sceneSDF evaluations
+// with COUNT_EVALUATIONS, which is empty in the plain variants.
+#ifdef MARCH_STATS
+#define TERMINATION_HIT 0u
+#define TERMINATION_MAX_DIST 1u
+#define TERMINATION_MAX_ITERATIONS 2u
+#ifndef MARCH_STATS_BINS
+#define MARCH_STATS_BINS 64
+#endif
+
+layout (std430, binding = 4) buffer MarchCounters {
+	uint terminations[3];
+	uint evaluations;
+	uint histogram[MARCH_STATS_BINS];
+};
+
+uint sdfEvaluations = 0;
+#define COUNT_EVALUATIONS(count) sdfEvaluations += count
+#else
+#define COUNT_EVALUATIONS(count)
+#endif